@@ -0,0 +1,149 @@
+/* Micro-benchmark: procfs parsing with sscanf vs the in-place tokenizers.
+ *
+ * Build and run with `make bench`. The sscanf side is the code ctop used
+ * before the tokenizers (fgets + one sscanf pattern per candidate key);
+ * the tokenizer side calls ctop's own parsers, so it measures what ships:
+ *
+ *   stat record   the sscanf pattern for the fields ctop takes from
+ *                 /proc/<pid>/stat vs scan_parse(), on a fixed record
+ *   /proc/meminfo fopen + fgets + sscanf vs parse_meminfo(), both
+ *                 including the read of the live file
+ *
+ * Both sides must agree on every value, or the benchmark fails. */
+#define main ctop_main
+#include "../ctop.c"
+#undef main
+
+#define STAT_ROUNDS 1000000
+#define MEMINFO_ROUNDS 100000
+
+/* A record with spaces and a ')' in comm, as the parser must handle them */
+static const char STAT_RECORD[] =
+    "28152 (Web (Content) 1) S 28148 28152 28148 0 -1 4194304 8211 0 17 0 1532 211 0 0 20 -5 37 0 "
+    "465046 2703360000 29913 18446744073709551615 94722338426880 94722338446761 140736680025920 0 "
+    "0 0 0 0 0 0 0 0 17 3 0 0 41 0 0 94722338462768 94722338464384 94722957012992 140736680031598 "
+    "140736680031618 140736680031618 140736680034283 0\n";
+
+static volatile unsigned long long g_sink;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* Fields scan_parse() keeps, the sscanf way */
+typedef struct {
+    int pid, ppid, nice, num_threads, processor;
+    char state;
+    unsigned long minflt, majflt, utime, stime;
+    unsigned long long starttime, vsize, blkio_ticks;
+    long rss;
+} StatFields;
+
+static void stat_sscanf(const char *line, StatFields *f) {
+    sscanf(line, "%d", &f->pid);
+    const char *end = strrchr(line, ')');
+    sscanf(end + 2, "%c %d %*d %*d %*d %*d %*u %lu %*u %lu %*u %lu %lu %*d %*d %*d %d %d %*d "
+           "%llu %llu %ld %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*d %d %*u %*u %llu",
+           &f->state, &f->ppid, &f->minflt, &f->majflt, &f->utime, &f->stime, &f->nice,
+           &f->num_threads, &f->starttime, &f->vsize, &f->rss, &f->processor, &f->blkio_ticks);
+}
+
+static void meminfo_sscanf(unsigned long *v) {
+    FILE *fp = fopen("/proc/meminfo", "r");
+    if (!fp) return;
+    char line[256];
+    while (fgets(line, sizeof(line), fp)) {
+        unsigned long val;
+        if (sscanf(line, "MemTotal: %lu", &val) == 1) v[0] = val;
+        else if (sscanf(line, "MemFree: %lu", &val) == 1) v[1] = val;
+        else if (sscanf(line, "MemAvailable: %lu", &val) == 1) v[2] = val;
+        else if (sscanf(line, "Buffers: %lu", &val) == 1) v[3] = val;
+        else if (sscanf(line, "Cached: %lu", &val) == 1) v[4] = val;
+        else if (sscanf(line, "SwapTotal: %lu", &val) == 1) v[5] = val;
+        else if (sscanf(line, "SwapFree: %lu", &val) == 1) v[6] = val;
+    }
+    fclose(fp);
+}
+
+static int check(const char *what, unsigned long long a, unsigned long long b) {
+    if (a == b) return 0;
+    fprintf(stderr, "parse_bench: %s differs: sscanf %llu, tokenizer %llu\n", what, a, b);
+    return 1;
+}
+
+static void report(const char *what, double sscanf_ns, double tok_ns) {
+    printf("%-14s sscanf %9.0f ns   tokenizer %9.0f ns   %5.1fx\n", what, sscanf_ns, tok_ns, sscanf_ns / tok_ns);
+}
+
+int main(void) {
+    char line[sizeof(STAT_RECORD)];
+
+    /* scan_parse() writes g_sample.processes[0]; no previous sample and no
+     * optional sources, so it only parses */
+    ScanPass *sp = &g_scan_pass;
+    if (reserve_scan_pass(sp, 1) != 0 ||
+        reserve_processes(&g_sample.processes, &g_sample.process_capacity, 1) != 0) return 1;
+    sp->pids[0] = 28152;
+    sp->cache_slot[0] = -1;
+    sp->page_kb = 4;
+    g_clk_tck = 100;
+
+    StatFields f;
+    memset(&f, 0, sizeof(f));
+    double t0 = now_ns();
+    for (int i = 0; i < STAT_ROUNDS; i++) {
+        stat_sscanf(STAT_RECORD, &f);
+        g_sink += f.utime + f.starttime;
+    }
+    double stat_sscanf_ns = (now_ns() - t0) / STAT_ROUNDS;
+
+    ProcessInfo *p = &g_sample.processes[0];
+    t0 = now_ns();
+    for (int i = 0; i < STAT_ROUNDS; i++) {
+        memcpy(line, STAT_RECORD, sizeof(line));   /* scan_parse() may write into it */
+        scan_parse(0, line);
+        g_sink += p->prev_utime + p->starttime;
+    }
+    double stat_tok_ns = (now_ns() - t0) / STAT_ROUNDS;
+
+    int bad = 0;
+    bad += check("pid", f.pid, p->pid);
+    bad += check("state", f.state, p->state);
+    bad += check("ppid", f.ppid, p->ppid);
+    bad += check("minflt", f.minflt, p->minflt);
+    bad += check("majflt", f.majflt, p->majflt);
+    bad += check("utime", f.utime, p->prev_utime);
+    bad += check("stime", f.stime, p->prev_stime);
+    bad += check("nice", f.nice, p->nice);
+    bad += check("num_threads", f.num_threads, p->num_threads);
+    bad += check("starttime", f.starttime, p->starttime);
+    bad += check("vsize", f.vsize, p->vsize);
+    bad += check("rss", f.rss * sp->page_kb, p->mem_rss);
+    bad += check("processor", f.processor, p->processor);
+    bad += check("blkio_ticks", f.blkio_ticks, p->blkio_ticks);
+
+    unsigned long mem[7] = {0};
+    t0 = now_ns();
+    for (int i = 0; i < MEMINFO_ROUNDS; i++) {
+        meminfo_sscanf(mem);
+        g_sink += mem[0];
+    }
+    double mem_sscanf_ns = (now_ns() - t0) / MEMINFO_ROUNDS;
+
+    t0 = now_ns();
+    for (int i = 0; i < MEMINFO_ROUNDS; i++) {
+        parse_meminfo();
+        g_sink += g_sample.total_mem;
+    }
+    double mem_tok_ns = (now_ns() - t0) / MEMINFO_ROUNDS;
+
+    /* MemFree and friends move between reads; the totals do not */
+    bad += check("MemTotal", mem[0], g_sample.total_mem);
+    bad += check("SwapTotal", mem[5], g_sample.swap_total);
+
+    report("stat record", stat_sscanf_ns, stat_tok_ns);
+    report("/proc/meminfo", mem_sscanf_ns, mem_tok_ns);
+    return bad ? 1 : 0;
+}
@@ -15,6 +15,36 @@
 #include <pwd.h>
 #include <sys/stat.h>
 #include <sys/statvfs.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/resource.h>
+#include <poll.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define HAVE_IO_URING 1
+#endif
+#if __has_include(<linux/cn_proc.h>)
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#define HAVE_PROC_EVENTS 1
+#endif
+#if __has_include(<linux/taskstats.h>) && __has_include(<linux/genetlink.h>)
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/taskstats.h>
+#define HAVE_TASKSTATS 1
+#endif
+#endif
+#endif
 
 #define TB_OPT_ATTR_W 32
 #define TB_IMPL
@@ -22,6 +52,12 @@
 
 #define CTOP_VERSION "1.0.0"
 #define REFRESH_RATE_MS 1000
+#define CPU_INTERVAL_MS 250
+#define PROC_INTERVAL_MS 2000
+#define BATTERY_INTERVAL_MS 30000
+#define EVENT_CHECK_MS 1000     /* How often change-driven collectors are checked */
+#define PROC_RESCAN_MS 30000    /* Full /proc listing interval while proc events are live */
+#define SCHEDSTAT_CPU_BELOW_MS 1000 /* Faster process sampling takes CPU% from schedstat */
 
 /* Colors matching btop++ */
 #define COLOR_BG 0x1a1a1a
@@ -41,10 +77,15 @@
 #define COLOR_TIME 0xffaa44
 
 /* Maximum values */
-#define MAX_PROCESSES 512
 #define MAX_CPU_CORES 256
 #define HISTORY_SIZE 120
 #define MAX_DISKS 32
+#define EXITED_MAX 64
+#define FD_CACHE_DEFAULT_LIMIT 4096
+#define FD_CACHE_RESERVE 64     /* stdio, terminal, sockets, pipes, config, dirfds */
+#define FD_RESERVE_PER_SCAN_THREAD 4    /* pid dirfd, task dirfd, scratch fd, io_uring ring */
+#define FD_RESERVE_PER_READER 2         /* pid dirfd, status or cmdline fd */
+#define DETAIL_FD_BUDGET 16     /* UI-side status fds, taken out of the reserve */
 
 #define PROC_PID_WIDTH 8
 #define PROC_CPU_WIDTH 6
@@ -76,24 +117,69 @@ typedef struct {
     int history_tx[HISTORY_SIZE];
 } DiskInfo;
 
-/* Process information structure */
+/* Delay accounting classes, as taskstats reports them */
+enum { DELAY_CPU, DELAY_BLKIO, DELAY_SWAPIN, DELAY_RECLAIM, NUM_DELAYS };
+
+/* /proc/<pid>/io counters, in the order the file lists them */
+enum { IO_RCHAR, IO_WCHAR, IO_SYSCR, IO_SYSCW, IO_READ_BYTES, IO_WRITE_BYTES, NUM_IO };
+
+/* Process information structure. Everything but the schedstat, taskstats
+ * and I/O fields comes from one parse of /proc/<pid>/stat; it is copied into every
+ * snapshot, so it is kept compact. */
 typedef struct {
     int pid;
-    int uid;
-    char name[256];
-    char cmdline[512];
-    char user[32];
+    int ppid;
+    char name[64];              /* comm; kernel thread names can exceed 16 bytes */
     char state;
-    long utime;
-    long stime;
-    long prev_utime;
+    signed char nice;
+    short processor;            /* CPU it last ran on */
+    int num_threads;
+    long prev_utime;            /* utime/stime in clock ticks, kept for the next delta */
     long prev_stime;
+    unsigned long long starttime;
+    unsigned long long vsize;   /* Bytes */
+    unsigned long minflt;
+    unsigned long majflt;
+    float minflt_rate;          /* Page faults per second; -1 until a delta exists */
+    float majflt_rate;
     long mem_rss;
     float cpu_percent;
     float cpu_percent_lazy;
     float mem_percent;
+    unsigned int ident_seq;     /* Bumped by exec and uid change events */
+    unsigned long long blkio_ticks; /* stat field 42, delayacct_blkio_ticks */
+    float delay[NUM_DELAYS];    /* ms spent waiting per second, by DELAY_*; -1 if unknown */
+    unsigned long long sched_run_ns;    /* schedstat on-CPU time; 0 if not read */
+    unsigned long long sched_wait_ns;   /* schedstat run-queue wait */
+    float run_delay;            /* Run-queue wait in ms per second; -1 if unknown */
+    unsigned long long io[NUM_IO];  /* /proc/<pid>/io totals, by IO_*; valid if have_io */
+    float io_rate[NUM_IO];      /* Per second; -1 if unknown */
+    unsigned char have_io;
 } ProcessInfo;
 
+/* A thread of an expanded process, from /proc/<pid>/task/<tid>/stat */
+typedef struct {
+    int tid;
+    int pid;                    /* Thread group it belongs to */
+    char name[16];
+    char state;
+    short processor;            /* CPU it last ran on */
+    long prev_utime;
+    long prev_stime;
+    unsigned long long starttime;
+    float cpu_percent;
+} ThreadInfo;
+
+/* A process the proc event stream saw exit */
+typedef struct {
+    int pid;
+    int ppid;
+    int status;                 /* As returned by wait() */
+    char name[16];
+    int64_t lifetime_ms;        /* -1 if it was gone before it could be read */
+    int64_t exit_ms;
+} ExitedProc;
+
 /* CPU core stats */
 typedef struct {
     unsigned long long user, nice, system, idle, iowait, irq, softirq, steal;
@@ -119,10 +205,15 @@ typedef struct {
     float swap_percent;
     int process_count;
     int running_count;
-    ProcessInfo processes[MAX_PROCESSES];
-    int cpu_history[HISTORY_SIZE];
+    int fd_dropped;             /* Processes the last scan skipped for lack of fds */
+    ProcessInfo *processes;     /* Growable; capacity is reused across samples */
+    int process_capacity;
+    unsigned int proc_generation;   /* Bumped by every process scan */
+    ThreadInfo *threads;        /* Of expanded processes, grouped by pid, busiest first */
+    int thread_count;
+    int thread_capacity;
     int mem_history[HISTORY_SIZE];
-    int history_index;
+    int mem_history_index;      /* Each collector advances its own history */
     unsigned long long net_rx_bytes;
     unsigned long long net_tx_bytes;
     unsigned long long prev_net_rx;
@@ -131,11 +222,17 @@ typedef struct {
     float net_tx_speed;
     int net_history_rx[HISTORY_SIZE];
     int net_history_tx[HISTORY_SIZE];
-    DiskInfo disks[MAX_DISKS];
+    int net_history_index;
+    DiskInfo *disks;            /* Points into one of the two disk generations */
     int num_disks;
+    int disk_history_index;
     int battery_percent;
     int battery_present;
     char battery_status[16];
+    ExitedProc exited[EXITED_MAX];  /* Ring; the newest is at exited_head - 1 */
+    int exited_head;
+    int exited_count;
+    int proc_events;            /* 1 while the proc event stream is live */
 } SystemStats;
 
 /* Pane visibility */
@@ -145,10 +242,21 @@ static int g_show_disks = 1;
 static int g_show_net = 1;
 static int g_show_proc = 1;
 
+/* The collector thread fills g_sample and publishes copies of it as snapshots;
+ * g_stats is the UI thread's copy of the snapshot it is currently showing */
+static SystemStats g_sample = {0};
 static SystemStats g_stats = {0};
+
+/* Previous-sample generations. Collectors fill the spare buffer while the
+ * last sample stays readable here, then swap pointers instead of copying. */
+static ProcessInfo *g_prev_procs = NULL;
+static int g_prev_proc_count = 0;
+static int g_prev_proc_capacity = 0;
+static DiskInfo g_disk_gen[2][MAX_DISKS];
 static int g_running = 1;
 static int g_selected_process = 0;
 static int g_scroll_offset = 0;
+static int g_proc_rows = 0;         /* process list rows drawn last frame */
 static int g_signal_menu_active = 0;
 static int g_signal_selected = 0;
 static int g_confirm_menu_active = 0;
@@ -196,21 +304,28 @@ int send_signal_to_process(int pid, int sig) {
 #define SORT_MEM 2
 #define SORT_PID 3
 #define SORT_NAME 4
-#define SORT_MAX 5
+#define SORT_COLUMN_BASE 5      /* Modes from here on sort by an optional column */
+#define SORT_MAX (SORT_COLUMN_BASE + NUM_PROC_COLUMNS)
 static int g_sort_mode = SORT_CPU_LAZY;
 static int g_refresh_rate_ms = REFRESH_RATE_MS;
-static float g_elapsed_seconds = 1.0f;
+static float g_elapsed_seconds = 1.0f;   /* Time covered by the running collector's delta */
 static long g_clk_tck = 0;
+static int g_fd_cache_limit = FD_CACHE_DEFAULT_LIMIT;
+static int g_scan_threads = 0;      /* Process scan threads; 0 picks min(CPUs, 8) */
+static int g_scan_threads_cli = 0;  /* -j, overrides the config without being saved */
+static int g_scan_io_uring = 0;     /* Opt-in io_uring stat pass, used if the kernel has it */
+static int g_proc_events_enabled = 1;   /* Track PIDs through proc events when permitted */
+static int g_show_exited = 0;       /* Process pane shows the recently exited list */
+static int g_tree_view = 0;         /* Process list shows the ppid hierarchy */
+static int g_show_threads = 0;      /* Threads of every process in view are listed */
+static unsigned int g_columns = 0;  /* Optional process columns shown, bit per PROC_COLUMNS entry */
+static int g_column_menu_active = 0;
+static int g_column_selected = 0;
 
-const char *get_sort_name(void) {
-    switch (g_sort_mode) {
-        case SORT_CPU_LAZY: return "CPU-L";
-        case SORT_CPU_DIRECT: return "CPU-D";
-        case SORT_MEM: return "Mem";
-        case SORT_PID: return "PID";
-        case SORT_NAME: return "Name";
-        default: return "CPU-L";
-    }
+int64_t get_time_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
 int is_number(const char *str) {
@@ -221,26 +336,164 @@ int is_number(const char *str) {
     return 1;
 }
 
-void get_username(int uid, char *buf, size_t buflen) {
-    struct passwd pwd;
-    struct passwd *result;
-    char *pwdbuf;
-    size_t pwdbuflen = sysconf(_SC_GETPW_R_SIZE_MAX);
-    if (pwdbuflen == (size_t)-1) pwdbuflen = 16384;
-    
-    pwdbuf = malloc(pwdbuflen);
-    if (!pwdbuf) {
-        snprintf(buf, buflen, "%d", uid);
+/* Open-addressing PID index: maps a PID to its slot in a process array.
+ * Rebuilt once per sample so lookups against the previous sample are O(1). */
+typedef struct {
+    int pid;    /* 0 marks an empty slot; PID 0 never appears in /proc */
+    int idx;
+} PidSlot;
+
+typedef struct {
+    PidSlot *slots;
+    unsigned int mask;
+    unsigned int capacity;
+} PidIndex;
+
+static inline unsigned int pid_hash(int pid) {
+    return (unsigned int)pid * 2654435761u;
+}
+
+/* Clear the index and make room for at least `count` entries at <= 50% load */
+static int pid_index_reset(PidIndex *ix, int count) {
+    unsigned int want = 64;
+    while (want < (unsigned int)count * 2) want <<= 1;
+    
+    if (want > ix->capacity) {
+        PidSlot *slots = realloc(ix->slots, want * sizeof(PidSlot));
+        if (!slots) return -1;
+        ix->slots = slots;
+        ix->capacity = want;
+    }
+    ix->mask = want - 1;
+    memset(ix->slots, 0, want * sizeof(PidSlot));
+    return 0;
+}
+
+static void pid_index_insert(PidIndex *ix, int pid, int idx) {
+    unsigned int h = pid_hash(pid) & ix->mask;
+    while (ix->slots[h].pid != 0 && ix->slots[h].pid != pid) {
+        h = (h + 1) & ix->mask;
+    }
+    ix->slots[h].pid = pid;
+    ix->slots[h].idx = idx;
+}
+
+/* Returns the slot stored for `pid`, or -1 if it is not indexed */
+static int pid_index_find(const PidIndex *ix, int pid) {
+    if (!ix->slots || pid <= 0) return -1;
+    unsigned int h = pid_hash(pid) & ix->mask;
+    while (ix->slots[h].pid != 0) {
+        if (ix->slots[h].pid == pid) return ix->slots[h].idx;
+        h = (h + 1) & ix->mask;
+    }
+    return -1;
+}
+
+/* uid -> username map. Each uid goes to NSS (getpwuid_r) once; the map is
+ * dropped when /etc/passwd changes so renamed or new users show up. Lookups
+ * run on the reader threads; lock guards the map but is never held across
+ * NSS, which can block on the network. */
+typedef struct {
+    int uid;
+    int used;
+    char name[32];
+} UserCacheEntry;
+
+static struct {
+    pthread_mutex_t lock;
+    UserCacheEntry *entries;
+    unsigned int capacity;      /* power of two */
+    unsigned int count;
+    time_t passwd_mtime;
+    ino_t passwd_ino;
+    off_t passwd_size;
+} g_user_cache = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+/* Invalidate the map if /etc/passwd was replaced or modified since last call */
+static void user_cache_revalidate(void) {
+    struct stat st;
+    if (stat("/etc/passwd", &st) != 0) return;
+    if (st.st_mtime == g_user_cache.passwd_mtime && st.st_ino == g_user_cache.passwd_ino &&
+        st.st_size == g_user_cache.passwd_size) {
         return;
     }
+    pthread_mutex_lock(&g_user_cache.lock);
+    g_user_cache.passwd_mtime = st.st_mtime;
+    g_user_cache.passwd_ino = st.st_ino;
+    g_user_cache.passwd_size = st.st_size;
+    if (g_user_cache.entries) {
+        memset(g_user_cache.entries, 0, g_user_cache.capacity * sizeof(UserCacheEntry));
+    }
+    g_user_cache.count = 0;
+    pthread_mutex_unlock(&g_user_cache.lock);
+}
+
+/* g_user_cache.lock is held */
+static UserCacheEntry *user_cache_slot(int uid) {
+    if ((g_user_cache.count + 1) * 2 > g_user_cache.capacity) {
+        unsigned int new_cap = g_user_cache.capacity ? g_user_cache.capacity * 2 : 64;
+        UserCacheEntry *grown = calloc(new_cap, sizeof(UserCacheEntry));
+        if (!grown) return NULL;
+        for (unsigned int i = 0; i < g_user_cache.capacity; i++) {
+            UserCacheEntry *e = &g_user_cache.entries[i];
+            if (!e->used) continue;
+            unsigned int h = pid_hash(e->uid) & (new_cap - 1);
+            while (grown[h].used) h = (h + 1) & (new_cap - 1);
+            grown[h] = *e;
+        }
+        free(g_user_cache.entries);
+        g_user_cache.entries = grown;
+        g_user_cache.capacity = new_cap;
+    }
     
-    if (getpwuid_r(uid, &pwd, pwdbuf, pwdbuflen, &result) == 0 && result) {
-        strncpy(buf, pwd.pw_name, buflen - 1);
+    unsigned int mask = g_user_cache.capacity - 1;
+    unsigned int h = pid_hash(uid) & mask;
+    while (g_user_cache.entries[h].used && g_user_cache.entries[h].uid != uid) {
+        h = (h + 1) & mask;
+    }
+    return &g_user_cache.entries[h];
+}
+
+void get_username(int uid, char *buf, size_t buflen) {
+    pthread_mutex_lock(&g_user_cache.lock);
+    UserCacheEntry *e = user_cache_slot(uid);
+    if (e && e->used) {
+        strncpy(buf, e->name, buflen - 1);
         buf[buflen - 1] = '\0';
+        pthread_mutex_unlock(&g_user_cache.lock);
+        return;
+    }
+    pthread_mutex_unlock(&g_user_cache.lock);
+    
+    char name[32];
+    struct passwd pwd;
+    struct passwd *result;
+    
+    /* A miss happens once per uid, so the buffer is not kept */
+    long pwbuf_len = sysconf(_SC_GETPW_R_SIZE_MAX);
+    if (pwbuf_len <= 0) pwbuf_len = 16384;
+    char *pwbuf = malloc(pwbuf_len);
+    if (pwbuf && getpwuid_r(uid, &pwd, pwbuf, pwbuf_len, &result) == 0 && result) {
+        strncpy(name, pwd.pw_name, sizeof(name) - 1);
+        name[sizeof(name) - 1] = '\0';
     } else {
-        snprintf(buf, buflen, "%d", uid);
+        snprintf(name, sizeof(name), "%d", uid);
     }
-    free(pwdbuf);
+    free(pwbuf);
+    
+    /* Unknown uids are cached too, so they are not looked up again. Another
+     * reader may have added this uid meanwhile. */
+    pthread_mutex_lock(&g_user_cache.lock);
+    e = user_cache_slot(uid);
+    if (e && !e->used) {
+        e->uid = uid;
+        e->used = 1;
+        memcpy(e->name, name, sizeof(e->name));
+        g_user_cache.count++;
+    }
+    pthread_mutex_unlock(&g_user_cache.lock);
+    strncpy(buf, name, buflen - 1);
+    buf[buflen - 1] = '\0';
 }
 
 void format_bytes(unsigned long bytes, char *buf, size_t buflen) {
@@ -254,6 +507,15 @@ void format_bytes(unsigned long bytes, char *buf, size_t buflen) {
     snprintf(buf, buflen, "%.2f %s", val, units[unit]);
 }
 
+void format_duration(int64_t ms, char *buf, size_t buflen) {
+    int64_t sec = ms / 1000;
+    if (sec < 1) snprintf(buf, buflen, "<1s");
+    else if (sec < 60) snprintf(buf, buflen, "%llds", (long long)sec);
+    else if (sec < 3600) snprintf(buf, buflen, "%lldm", (long long)(sec / 60));
+    else if (sec < 2 * 86400) snprintf(buf, buflen, "%lldh", (long long)(sec / 3600));
+    else snprintf(buf, buflen, "%lldd", (long long)(sec / 86400));
+}
+
 void format_speed(float kbps, char *buf, size_t buflen) {
     if (kbps >= 1024 * 1024) {
         snprintf(buf, buflen, "%.2f GiB/s", kbps / (1024 * 1024));
@@ -264,33 +526,117 @@ void format_speed(float kbps, char *buf, size_t buflen) {
     }
 }
 
-void parse_cpu_stats(void) {
-    FILE *fp = fopen("/proc/stat", "r");
-    if (!fp) return;
+/* Zero-allocation procfs tokenizers. They walk a NUL-terminated read buffer in
+ * place; every parse_* helper advances the cursor past what it consumed. */
+static inline const char *tok_skip_ws(const char *p) {
+    while (*p == ' ' || *p == '\t') p++;
+    return p;
+}
+
+/* Skip `n` whitespace-separated fields on the current line */
+static inline const char *tok_skip_fields(const char *p, int n) {
+    while (n-- > 0) {
+        p = tok_skip_ws(p);
+        while (*p && *p != ' ' && *p != '\t' && *p != '\n') p++;
+    }
+    return p;
+}
+
+static inline unsigned long long tok_ull(const char **pp) {
+    const char *p = tok_skip_ws(*pp);
+    unsigned long long v = 0;
+    while ((unsigned char)(*p - '0') < 10) {
+        v = v * 10 + (unsigned)(*p - '0');
+        p++;
+    }
+    *pp = p;
+    return v;
+}
+
+static inline long long tok_ll(const char **pp) {
+    const char *p = tok_skip_ws(*pp);
+    int neg = (*p == '-');
+    p += neg;
+    *pp = p;
+    long long v = (long long)tok_ull(pp);
+    return neg ? -v : v;
+}
+
+static inline const char *tok_next_line(const char *p) {
+    const char *nl = strchr(p, '\n');
+    return nl ? nl + 1 : p + strlen(p);
+}
+
+/* Read a whole small file relative to `dirfd` with one read(); the result is
+ * NUL-terminated. Returns the number of bytes read or -1. */
+static ssize_t read_file_at(int dirfd, const char *name, char *buf, size_t size) {
+    int fd = openat(dirfd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+    if (n < 0) return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+/* Growable buffer for system-wide files whose size depends on the host
+ * (/proc/stat grows with cores, /proc/net/dev with interfaces) */
+typedef struct {
+    char *data;
+    size_t cap;
+} ReadBuf;
+
+static ReadBuf g_sysbuf;
+
+/* Read all of `path` into `rb`, growing it as needed; NUL-terminated */
+static ssize_t read_whole_file(const char *path, ReadBuf *rb) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    
+    size_t len = 0;
+    for (;;) {
+        if (rb->cap - len < 2) {
+            size_t new_cap = rb->cap ? rb->cap * 2 : 16384;
+            char *grown = realloc(rb->data, new_cap);
+            if (!grown) break;
+            rb->data = grown;
+            rb->cap = new_cap;
+        }
+        ssize_t n = read(fd, rb->data + len, rb->cap - len - 1);
+        if (n <= 0) break;
+        len += n;
+    }
+    close(fd);
     
-    char line[256];
+    if (!rb->data) return -1;
+    rb->data[len] = '\0';
+    return (ssize_t)len;
+}
+
+void parse_cpu_stats(void) {
+    if (read_whole_file("/proc/stat", &g_sysbuf) <= 0) return;
     
-    while (fgets(line, sizeof(line), fp)) {
-        if (strncmp(line, "cpu", 3) != 0) continue;
-        
+    /* The cpu lines come first; stop at the first other line (intr is huge) */
+    for (const char *line = g_sysbuf.data; strncmp(line, "cpu", 3) == 0; line = tok_next_line(line)) {
         CoreStat *core = NULL;
-        if (line[3] == ' ') {
-            core = &g_stats.overall;
+        const char *p = line + 3;
+        if (*p == ' ') {
+            core = &g_sample.overall;
         } else {
-            int n;
-            if (sscanf(line, "cpu%d", &n) == 1 && n < MAX_CPU_CORES) {
-                core = &g_stats.cores[n];
-                if (n >= g_stats.num_cores) g_stats.num_cores = n + 1;
-            } else {
-                continue;
-            }
+            unsigned long long n = tok_ull(&p);
+            if (n >= MAX_CPU_CORES) continue;
+            core = &g_sample.cores[n];
+            if ((int)n >= g_sample.num_cores) g_sample.num_cores = n + 1;
         }
         
-        if (!core) continue;
-        
-        unsigned long long user, nice, system, idle, iowait, irq, softirq, steal;
-        sscanf(line, "%*s %llu %llu %llu %llu %llu %llu %llu %llu",
-               &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal);
+        unsigned long long user = tok_ull(&p);
+        unsigned long long nice = tok_ull(&p);
+        unsigned long long system = tok_ull(&p);
+        unsigned long long idle = tok_ull(&p);
+        unsigned long long iowait = tok_ull(&p);
+        unsigned long long irq = tok_ull(&p);
+        unsigned long long softirq = tok_ull(&p);
+        unsigned long long steal = tok_ull(&p);
         
         unsigned long long total = user + nice + system + idle + iowait + irq + softirq + steal;
         unsigned long long idle_time = idle + iowait;
@@ -309,363 +655,3320 @@ void parse_cpu_stats(void) {
         core->prev_total = total;
         core->prev_idle = idle_time;
     }
-    
-    g_stats.cpu_history[g_stats.history_index] = (int)g_stats.overall.percent;
-    fclose(fp);
 }
 
 void parse_meminfo(void) {
-    FILE *fp = fopen("/proc/meminfo", "r");
-    if (!fp) return;
-    
-    char line[256];
-    while (fgets(line, sizeof(line), fp)) {
-        unsigned long val;
-        if (sscanf(line, "MemTotal: %lu", &val) == 1) {
-            g_stats.total_mem = val;
-        } else if (sscanf(line, "MemFree: %lu", &val) == 1) {
-            g_stats.free_mem = val;
-        } else if (sscanf(line, "MemAvailable: %lu", &val) == 1) {
-            g_stats.available_mem = val;
-        } else if (sscanf(line, "Buffers: %lu", &val) == 1) {
-            g_stats.buffers = val;
-        } else if (sscanf(line, "Cached: %lu", &val) == 1) {
-            g_stats.cached = val;
-        } else if (sscanf(line, "SwapTotal: %lu", &val) == 1) {
-            g_stats.swap_total = val;
-        } else if (sscanf(line, "SwapFree: %lu", &val) == 1) {
-            g_stats.swap_free = val;
+    static const struct {
+        const char *key;
+        size_t len;
+        unsigned long *dst;
+    } fields[] = {
+        {"MemTotal:", 9, &g_sample.total_mem},
+        {"MemFree:", 8, &g_sample.free_mem},
+        {"MemAvailable:", 13, &g_sample.available_mem},
+        {"Buffers:", 8, &g_sample.buffers},
+        {"Cached:", 7, &g_sample.cached},
+        {"SwapTotal:", 10, &g_sample.swap_total},
+        {"SwapFree:", 9, &g_sample.swap_free},
+    };
+    const int num_fields = sizeof(fields) / sizeof(fields[0]);
+    
+    if (read_whole_file("/proc/meminfo", &g_sysbuf) <= 0) return;
+    
+    int found = 0;
+    for (const char *line = g_sysbuf.data; *line && found < num_fields; line = tok_next_line(line)) {
+        for (int i = 0; i < num_fields; i++) {
+            if (line[0] == fields[i].key[0] && strncmp(line, fields[i].key, fields[i].len) == 0) {
+                const char *p = line + fields[i].len;
+                *fields[i].dst = tok_ull(&p);
+                found++;
+                break;
+            }
         }
     }
-    fclose(fp);
     
-    if (g_stats.total_mem > 0) {
-        unsigned long used = g_stats.total_mem - g_stats.available_mem;
-        g_stats.mem_percent = (used * 100.0f) / g_stats.total_mem;
+    if (g_sample.total_mem > 0) {
+        unsigned long used = g_sample.total_mem - g_sample.available_mem;
+        g_sample.mem_percent = (used * 100.0f) / g_sample.total_mem;
     }
     
-    if (g_stats.swap_total > 0) {
-        unsigned long used = g_stats.swap_total - g_stats.swap_free;
-        g_stats.swap_percent = (used * 100.0f) / g_stats.swap_total;
+    if (g_sample.swap_total > 0) {
+        unsigned long used = g_sample.swap_total - g_sample.swap_free;
+        g_sample.swap_percent = (used * 100.0f) / g_sample.swap_total;
     }
     
-    g_stats.mem_history[g_stats.history_index] = (int)g_stats.mem_percent;
+    g_sample.mem_history[g_sample.mem_history_index] = (int)g_sample.mem_percent;
+    g_sample.mem_history_index = (g_sample.mem_history_index + 1) % HISTORY_SIZE;
 }
 
 void parse_net_stats(void) {
-    FILE *fp = fopen("/proc/net/dev", "r");
-    if (!fp) return;
+    if (read_whole_file("/proc/net/dev", &g_sysbuf) <= 0) return;
     
-    char line[512];
     unsigned long long total_rx = 0, total_tx = 0;
     
-    fgets(line, sizeof(line), fp);
-    fgets(line, sizeof(line), fp);
+    /* Skip the two header lines */
+    const char *line = tok_next_line(tok_next_line(g_sysbuf.data));
     
-    while (fgets(line, sizeof(line), fp)) {
-        char iface[32];
-        unsigned long long rx_bytes, tx_bytes;
+    for (; *line; line = tok_next_line(line)) {
+        /* "  iface: rx_bytes packets errs drop fifo frame compressed multicast tx_bytes ..." */
+        const char *name = tok_skip_ws(line);
+        const char *colon = strchr(name, ':');
+        if (!colon) continue;
         
-        sscanf(line, "%s %llu %*u %*u %*u %*u %*u %*u %*u %llu",
-               iface, &rx_bytes, &tx_bytes);
+        if (colon - name == 2 && strncmp(name, "lo", 2) == 0) continue;
         
-        if (strcmp(iface, "lo:") == 0) continue;
+        const char *p = colon + 1;
+        unsigned long long rx_bytes = tok_ull(&p);
+        p = tok_skip_fields(p, 7);
+        unsigned long long tx_bytes = tok_ull(&p);
         
         total_rx += rx_bytes;
         total_tx += tx_bytes;
     }
-    fclose(fp);
     
-    if (g_stats.prev_net_rx > 0) {
-        g_stats.net_rx_speed = (total_rx - g_stats.prev_net_rx) / 1024.0f;
-        g_stats.net_tx_speed = (total_tx - g_stats.prev_net_tx) / 1024.0f;
+    if (g_sample.prev_net_rx > 0 && g_elapsed_seconds > 0) {
+        g_sample.net_rx_speed = (total_rx - g_sample.prev_net_rx) / 1024.0f / g_elapsed_seconds;
+        g_sample.net_tx_speed = (total_tx - g_sample.prev_net_tx) / 1024.0f / g_elapsed_seconds;
+    }
+    
+    g_sample.net_history_rx[g_sample.net_history_index] = (int)(g_sample.net_rx_speed / 100);
+    g_sample.net_history_tx[g_sample.net_history_index] = (int)(g_sample.net_tx_speed / 100);
+    g_sample.net_history_index = (g_sample.net_history_index + 1) % HISTORY_SIZE;
+    
+    g_sample.prev_net_rx = total_rx;
+    g_sample.prev_net_tx = total_tx;
+}
+
+static unsigned int get_sector_size(const char *name) {
+    char path[128];
+    char buf[32];
+    snprintf(path, sizeof(path), "/sys/block/%s/queue/hw_sector_size", name);
+    if (read_file_at(AT_FDCWD, path, buf, sizeof(buf)) <= 0) return 512;
+    const char *p = buf;
+    unsigned int size = (unsigned int)tok_ull(&p);
+    return size > 0 ? size : 512;
+}
+
+/* Mounted block devices; the table is re-read only when the kernel reports a
+ * mount change, which it signals as POLLPRI on an open /proc/self/mounts */
+typedef struct {
+    char device[32];            /* Basename of the /dev node */
+    char mount[256];
+} MountEntry;
+
+static MountEntry g_mounts[MAX_DISKS];
+static int g_num_mounts = 0;
+static int g_mounts_fd = -1;
+
+static int mounts_changed(void) {
+    if (g_mounts_fd < 0) return 1;
+    struct pollfd pfd = {g_mounts_fd, POLLPRI, 0};
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & (POLLPRI | POLLERR));
+}
+
+void parse_mounts(void) {
+    /* Open the watch fd before reading so a change in between is not missed */
+    if (g_mounts_fd < 0) g_mounts_fd = open("/proc/self/mounts", O_RDONLY | O_CLOEXEC);
+    if (read_whole_file("/proc/self/mounts", &g_sysbuf) <= 0) return;
+    
+    g_num_mounts = 0;
+    for (const char *line = g_sysbuf.data; *line && g_num_mounts < MAX_DISKS; line = tok_next_line(line)) {
+        /* "device mountpoint fstype options 0 0"; only real block devices */
+        if (strncmp(line, "/dev/", 5) != 0) continue;
+        const char *dev_end = line;
+        while (*dev_end && *dev_end != ' ') dev_end++;
+        const char *dev = dev_end;
+        while (dev > line && dev[-1] != '/') dev--;
+        const char *mnt = tok_skip_ws(dev_end);
+        const char *mnt_end = mnt;
+        while (*mnt_end && *mnt_end != ' ' && *mnt_end != '\n') mnt_end++;
+        
+        size_t dev_len = dev_end - dev;
+        size_t mnt_len = mnt_end - mnt;
+        if (dev_len == 0 || dev_len >= sizeof(g_mounts[0].device) ||
+            mnt_len == 0 || mnt_len >= sizeof(g_mounts[0].mount)) continue;
+        
+        /* Keep the first mount of a device; later ones are usually binds */
+        int dup = 0;
+        for (int i = 0; i < g_num_mounts && !dup; i++) {
+            dup = strncmp(g_mounts[i].device, dev, dev_len) == 0 && g_mounts[i].device[dev_len] == '\0';
+        }
+        if (dup) continue;
+        
+        MountEntry *m = &g_mounts[g_num_mounts++];
+        memcpy(m->device, dev, dev_len);
+        m->device[dev_len] = '\0';
+        memcpy(m->mount, mnt, mnt_len);
+        m->mount[mnt_len] = '\0';
+    }
+}
+
+/* Attach the mount point and filesystem usage of a mounted disk */
+static void disk_usage(DiskInfo *disk) {
+    for (int i = 0; i < g_num_mounts; i++) {
+        if (strcmp(g_mounts[i].device, disk->name) != 0) continue;
+        
+        memcpy(disk->device, g_mounts[i].device, sizeof(disk->device));
+        memcpy(disk->mount, g_mounts[i].mount, sizeof(disk->mount));
+        struct statvfs vfs;
+        if (statvfs(disk->mount, &vfs) == 0) {
+            disk->total = (unsigned long long)vfs.f_blocks * vfs.f_frsize;
+            disk->free = (unsigned long long)vfs.f_bavail * vfs.f_frsize;
+            disk->used = (unsigned long long)(vfs.f_blocks - vfs.f_bfree) * vfs.f_frsize;
+        }
+        return;
+    }
+}
+
+void parse_disk_stats(void) {
+    if (read_whole_file("/proc/diskstats", &g_sysbuf) <= 0) return;
+    
+    DiskInfo *prev_disks = g_sample.disks;
+    int prev_disk_count = g_sample.num_disks;
+    DiskInfo *new_disks = (prev_disks == g_disk_gen[0]) ? g_disk_gen[1] : g_disk_gen[0];
+    int new_disk_count = 0;
+    
+    for (const char *line = g_sysbuf.data; *line && new_disk_count < MAX_DISKS; line = tok_next_line(line)) {
+        /* "major minor name reads merged sectors_read ms writes merged sectors_written ..." */
+        const char *p = tok_skip_fields(line, 2);
+        const char *name_start = tok_skip_ws(p);
+        p = tok_skip_fields(p, 1);
+        size_t name_len = p - name_start;
+        if (name_len == 0 || name_len >= sizeof(new_disks[0].name)) continue;
+        
+        char name[32];
+        memcpy(name, name_start, name_len);
+        name[name_len] = '\0';
+        
+        if (strncmp(name, "loop", 4) == 0 || 
+            strncmp(name, "ram", 3) == 0 ||
+            strncmp(name, "dm-", 3) == 0) continue;
+        
+        p = tok_skip_fields(p, 2);
+        unsigned long long read_sectors = tok_ull(&p);
+        p = tok_skip_fields(p, 3);
+        unsigned long long write_sectors = tok_ull(&p);
+        
+        unsigned int sector_size = get_sector_size(name);
+        
+        DiskInfo *disk = &new_disks[new_disk_count];
+        memset(disk, 0, sizeof(DiskInfo));
+        memcpy(disk->name, name, name_len + 1);
+        
+        for (int i = 0; i < prev_disk_count; i++) {
+            if (strcmp(prev_disks[i].name, name) == 0) {
+                unsigned long long read_diff = (read_sectors - prev_disks[i].read_sectors) * sector_size;
+                unsigned long long write_diff = (write_sectors - prev_disks[i].write_sectors) * sector_size;
+                if (g_elapsed_seconds > 0) {
+                    disk->read_speed = read_diff / 1024.0f / g_elapsed_seconds;
+                    disk->write_speed = write_diff / 1024.0f / g_elapsed_seconds;
+                }
+                memcpy(disk->history_rx, prev_disks[i].history_rx, sizeof(disk->history_rx));
+                memcpy(disk->history_tx, prev_disks[i].history_tx, sizeof(disk->history_tx));
+                break;
+            }
+        }
+        
+        disk->read_sectors = read_sectors;
+        disk->write_sectors = write_sectors;
+        disk->history_rx[g_sample.disk_history_index] = (int)(disk->read_speed / 100);
+        disk->history_tx[g_sample.disk_history_index] = (int)(disk->write_speed / 100);
+        disk_usage(disk);
+        
+        new_disk_count++;
+    }
+    
+    g_sample.disks = new_disks;
+    g_sample.num_disks = new_disk_count;
+    g_sample.disk_history_index = (g_sample.disk_history_index + 1) % HISTORY_SIZE;
+}
+
+void parse_battery(void) {
+    DIR *dir = opendir("/sys/class/power_supply");
+    if (!dir) {
+        g_sample.battery_present = 0;
+        return;
+    }
+    
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "BAT", 3) != 0) continue;
+        
+        char path[512];
+        char buf[32];
+        
+        snprintf(path, sizeof(path), "/sys/class/power_supply/%s/capacity", entry->d_name);
+        if (read_file_at(AT_FDCWD, path, buf, sizeof(buf)) > 0) {
+            const char *p = buf;
+            g_sample.battery_percent = (int)tok_ll(&p);
+            g_sample.battery_present = 1;
+        }
+        
+        snprintf(path, sizeof(path), "/sys/class/power_supply/%s/status", entry->d_name);
+        if (read_file_at(AT_FDCWD, path, g_sample.battery_status, sizeof(g_sample.battery_status)) > 0) {
+            g_sample.battery_status[strcspn(g_sample.battery_status, "\n")] = '\0';
+        }
+        break;
+    }
+    closedir(dir);
+}
+
+/* Make room for `need` entries in a process table, growing geometrically so a
+ * steady process count never reallocates. Returns -1 if memory runs out. */
+static int reserve_processes(ProcessInfo **table, int *capacity, int need) {
+    if (need <= *capacity) return 0;
+    
+    int new_cap = *capacity > 0 ? *capacity : 1024;
+    while (new_cap < need) new_cap *= 2;
+    
+    ProcessInfo *grown = realloc(*table, sizeof(ProcessInfo) * new_cap);
+    if (!grown) return -1;
+    *table = grown;
+    *capacity = new_cap;
+    return 0;
+}
+
+static int reserve_threads(ThreadInfo **table, int *capacity, int need) {
+    if (need <= *capacity) return 0;
+    
+    int new_cap = *capacity > 0 ? *capacity : 256;
+    while (new_cap < need) new_cap *= 2;
+    
+    ThreadInfo *grown = realloc(*table, sizeof(ThreadInfo) * new_cap);
+    if (!grown) return -1;
+    *table = grown;
+    *capacity = new_cap;
+    return 0;
+}
+
+/* Process comparators, one per sort mode, so the mode is resolved once per
+ * sort rather than on every comparison. Ties fall back to PID, which makes
+ * the order total and stable between ticks. */
+typedef int (*ProcCompare)(const ProcessInfo *a, const ProcessInfo *b);
+
+static inline int cmp_pid_tiebreak(const ProcessInfo *a, const ProcessInfo *b) {
+    return (a->pid > b->pid) - (a->pid < b->pid);
+}
+
+static int cmp_cpu_lazy(const ProcessInfo *a, const ProcessInfo *b) {
+    if (b->cpu_percent_lazy > a->cpu_percent_lazy) return 1;
+    if (b->cpu_percent_lazy < a->cpu_percent_lazy) return -1;
+    return cmp_pid_tiebreak(a, b);
+}
+
+static int cmp_cpu_direct(const ProcessInfo *a, const ProcessInfo *b) {
+    if (b->cpu_percent > a->cpu_percent) return 1;
+    if (b->cpu_percent < a->cpu_percent) return -1;
+    return cmp_pid_tiebreak(a, b);
+}
+
+static int cmp_mem(const ProcessInfo *a, const ProcessInfo *b) {
+    if (b->mem_rss > a->mem_rss) return 1;
+    if (b->mem_rss < a->mem_rss) return -1;
+    return cmp_pid_tiebreak(a, b);
+}
+
+static int cmp_pid(const ProcessInfo *a, const ProcessInfo *b) {
+    return cmp_pid_tiebreak(a, b);
+}
+
+static int cmp_name(const ProcessInfo *a, const ProcessInfo *b) {
+    int r = strcasecmp(a->name, b->name);
+    return r ? r : cmp_pid_tiebreak(a, b);
+}
+
+/* Optional process columns. Each one is also a sort mode (SORT_COLUMN_BASE +
+ * its index, so entries are only ever appended) and names the source the
+ * collector has to read for it; sources nobody shows or sorts by are skipped. */
+enum { COLSRC_STAT, COLSRC_TASKSTATS, COLSRC_SCHEDSTAT, COLSRC_IO };
+
+#define PROC_DELAY_WIDTH 7
+
+typedef struct {
+    const char *key;            /* Name in the columns= config list */
+    const char *header;
+    const char *label;          /* Column menu entry */
+    int width;
+    int source;
+    ProcCompare compare;
+    void (*format)(const ProcessInfo *p, char *buf, size_t buflen);
+} ProcColumn;
+
+/* Descending by a numeric field, then by PID */
+#define CMP_DESC(name, field) \
+    static int name(const ProcessInfo *a, const ProcessInfo *b) { \
+        if (b->field > a->field) return 1; \
+        if (b->field < a->field) return -1; \
+        return cmp_pid_tiebreak(a, b); \
+    }
+
+CMP_DESC(cmp_cpu_delay, delay[DELAY_CPU])
+CMP_DESC(cmp_blkio_delay, delay[DELAY_BLKIO])
+CMP_DESC(cmp_swapin_delay, delay[DELAY_SWAPIN])
+CMP_DESC(cmp_reclaim_delay, delay[DELAY_RECLAIM])
+CMP_DESC(cmp_run_delay, run_delay)
+CMP_DESC(cmp_threads, num_threads)
+CMP_DESC(cmp_nice, nice)
+CMP_DESC(cmp_processor, processor)
+CMP_DESC(cmp_age, starttime)            /* Youngest first */
+CMP_DESC(cmp_vsize, vsize)
+CMP_DESC(cmp_minflt_rate, minflt_rate)
+CMP_DESC(cmp_majflt_rate, majflt_rate)
+CMP_DESC(cmp_blkio_ticks, blkio_ticks)
+CMP_DESC(cmp_io_read, io_rate[IO_READ_BYTES])
+CMP_DESC(cmp_io_write, io_rate[IO_WRITE_BYTES])
+CMP_DESC(cmp_io_rchar, io_rate[IO_RCHAR])
+CMP_DESC(cmp_io_wchar, io_rate[IO_WCHAR])
+CMP_DESC(cmp_io_syscr, io_rate[IO_SYSCR])
+CMP_DESC(cmp_io_syscw, io_rate[IO_SYSCW])
+
+static void format_delay(float ms_per_s, char *buf, size_t buflen) {
+    if (ms_per_s < 0) snprintf(buf, buflen, "-");
+    else snprintf(buf, buflen, "%.1f", ms_per_s);
+}
+
+static void fmt_cpu_delay(const ProcessInfo *p, char *buf, size_t n) { format_delay(p->delay[DELAY_CPU], buf, n); }
+static void fmt_blkio_delay(const ProcessInfo *p, char *buf, size_t n) { format_delay(p->delay[DELAY_BLKIO], buf, n); }
+static void fmt_swapin_delay(const ProcessInfo *p, char *buf, size_t n) { format_delay(p->delay[DELAY_SWAPIN], buf, n); }
+static void fmt_reclaim_delay(const ProcessInfo *p, char *buf, size_t n) { format_delay(p->delay[DELAY_RECLAIM], buf, n); }
+static void fmt_run_delay(const ProcessInfo *p, char *buf, size_t n) { format_delay(p->run_delay, buf, n); }
+static void fmt_threads(const ProcessInfo *p, char *buf, size_t n) { snprintf(buf, n, "%d", p->num_threads); }
+static void fmt_nice(const ProcessInfo *p, char *buf, size_t n) { snprintf(buf, n, "%d", p->nice); }
+static void fmt_processor(const ProcessInfo *p, char *buf, size_t n) { snprintf(buf, n, "%d", p->processor); }
+static void fmt_vsize(const ProcessInfo *p, char *buf, size_t n) { format_bytes(p->vsize, buf, n); }
+
+static void fmt_age(const ProcessInfo *p, char *buf, size_t n) {
+    struct timespec ts;
+    if (g_clk_tck <= 0 || clock_gettime(CLOCK_BOOTTIME, &ts) != 0) {
+        snprintf(buf, n, "-");
+        return;
+    }
+    int64_t start_ms = (int64_t)(p->starttime * 1000 / g_clk_tck);
+    format_duration((int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 - start_ms, buf, n);
+}
+
+static void format_rate(float per_s, char *buf, size_t buflen) {
+    if (per_s < 0) snprintf(buf, buflen, "-");
+    else snprintf(buf, buflen, "%.0f", per_s);
+}
+
+static void fmt_minflt_rate(const ProcessInfo *p, char *buf, size_t n) { format_rate(p->minflt_rate, buf, n); }
+static void fmt_majflt_rate(const ProcessInfo *p, char *buf, size_t n) { format_rate(p->majflt_rate, buf, n); }
+
+/* Total time spent waiting for block I/O, from delayacct_blkio_ticks */
+static void fmt_blkio_ticks(const ProcessInfo *p, char *buf, size_t n) {
+    if (p->blkio_ticks == 0 || g_clk_tck <= 0) snprintf(buf, n, "0");
+    else format_duration((int64_t)(p->blkio_ticks * 1000 / g_clk_tck), buf, n);
+}
+
+static void format_byte_rate(float per_s, char *buf, size_t buflen) {
+    if (per_s < 0) snprintf(buf, buflen, "-");
+    else format_bytes((unsigned long)per_s, buf, buflen);
+}
+
+static void fmt_io_read(const ProcessInfo *p, char *buf, size_t n) { format_byte_rate(p->io_rate[IO_READ_BYTES], buf, n); }
+static void fmt_io_write(const ProcessInfo *p, char *buf, size_t n) { format_byte_rate(p->io_rate[IO_WRITE_BYTES], buf, n); }
+static void fmt_io_rchar(const ProcessInfo *p, char *buf, size_t n) { format_byte_rate(p->io_rate[IO_RCHAR], buf, n); }
+static void fmt_io_wchar(const ProcessInfo *p, char *buf, size_t n) { format_byte_rate(p->io_rate[IO_WCHAR], buf, n); }
+static void fmt_io_syscr(const ProcessInfo *p, char *buf, size_t n) { format_rate(p->io_rate[IO_SYSCR], buf, n); }
+static void fmt_io_syscw(const ProcessInfo *p, char *buf, size_t n) { format_rate(p->io_rate[IO_SYSCW], buf, n); }
+
+static const ProcColumn PROC_COLUMNS[] = {
+    {"cpu_delay", "CpuDly", "CPU run-queue delay (ms/s)", PROC_DELAY_WIDTH, COLSRC_TASKSTATS,
+     cmp_cpu_delay, fmt_cpu_delay},
+    {"io_delay", "IODly", "Block I/O delay (ms/s)", PROC_DELAY_WIDTH, COLSRC_TASKSTATS,
+     cmp_blkio_delay, fmt_blkio_delay},
+    {"swapin_delay", "SwpDly", "Swap-in delay (ms/s)", PROC_DELAY_WIDTH, COLSRC_TASKSTATS,
+     cmp_swapin_delay, fmt_swapin_delay},
+    {"reclaim_delay", "RclDly", "Memory reclaim delay (ms/s)", PROC_DELAY_WIDTH, COLSRC_TASKSTATS,
+     cmp_reclaim_delay, fmt_reclaim_delay},
+    {"run_delay", "RunDly", "Run-queue wait, schedstat (ms/s)", PROC_DELAY_WIDTH, COLSRC_SCHEDSTAT,
+     cmp_run_delay, fmt_run_delay},
+    {"threads", "Thr", "Threads", 5, COLSRC_STAT, cmp_threads, fmt_threads},
+    {"nice", "Ni", "Nice", 3, COLSRC_STAT, cmp_nice, fmt_nice},
+    {"last_cpu", "CPU", "Last CPU", 4, COLSRC_STAT, cmp_processor, fmt_processor},
+    {"age", "Age", "Age (youngest first)", 5, COLSRC_STAT, cmp_age, fmt_age},
+    {"vsize", "VSZ", "Virtual size", 10, COLSRC_STAT, cmp_vsize, fmt_vsize},
+    {"minflt_rate", "MinF/s", "Minor page faults (per s)", 7, COLSRC_STAT, cmp_minflt_rate, fmt_minflt_rate},
+    {"majflt_rate", "MajF/s", "Major page faults (per s)", 7, COLSRC_STAT, cmp_majflt_rate, fmt_majflt_rate},
+    {"io_wait", "IOWait", "Total block I/O wait", 6, COLSRC_STAT, cmp_blkio_ticks, fmt_blkio_ticks},
+    {"io_read", "IO R/s", "Storage reads (bytes/s)", 10, COLSRC_IO, cmp_io_read, fmt_io_read},
+    {"io_write", "IO W/s", "Storage writes (bytes/s)", 10, COLSRC_IO, cmp_io_write, fmt_io_write},
+    {"rchar", "RChar/s", "Bytes read by syscalls (per s)", 10, COLSRC_IO, cmp_io_rchar, fmt_io_rchar},
+    {"wchar", "WChar/s", "Bytes written by syscalls (per s)", 10, COLSRC_IO, cmp_io_wchar, fmt_io_wchar},
+    {"syscr", "RdSc/s", "Read syscalls (per s)", 7, COLSRC_IO, cmp_io_syscr, fmt_io_syscr},
+    {"syscw", "WrSc/s", "Write syscalls (per s)", 7, COLSRC_IO, cmp_io_syscw, fmt_io_syscw},
+};
+#define NUM_PROC_COLUMNS ((int)(sizeof(PROC_COLUMNS) / sizeof(PROC_COLUMNS[0])))
+
+/* Optional column the sort mode sorts by, or -1 */
+static inline int sort_column(int mode) {
+    return mode >= SORT_COLUMN_BASE && mode < SORT_MAX ? mode - SORT_COLUMN_BASE : -1;
+}
+
+/* A column's sort mode only takes part in the Ctrl+F/B cycle while shown */
+static int sort_mode_available(int mode) {
+    int col = sort_column(mode);
+    return col < 0 || (g_columns & (1u << col));
+}
+
+const char *get_sort_name(void) {
+    int col = sort_column(g_sort_mode);
+    if (col >= 0) return PROC_COLUMNS[col].header;
+    switch (g_sort_mode) {
+        case SORT_CPU_LAZY: return "CPU-L";
+        case SORT_CPU_DIRECT: return "CPU-D";
+        case SORT_MEM: return "Mem";
+        case SORT_PID: return "PID";
+        case SORT_NAME: return "Name";
+        default: return "CPU-L";
+    }
+}
+
+/* Collector side: 1 if `source` feeds a shown column, 2 if it also feeds the
+ * sort key (so every process needs it), 0 if nothing uses it */
+static int column_source_use(int source) {
+    unsigned int shown_cols = __atomic_load_n(&g_columns, __ATOMIC_RELAXED);
+    int col = sort_column(__atomic_load_n(&g_sort_mode, __ATOMIC_RELAXED));
+    if (col >= 0 && PROC_COLUMNS[col].source == source) return 2;
+    for (int i = 0; i < NUM_PROC_COLUMNS; i++) {
+        if ((shown_cols & (1u << i)) && PROC_COLUMNS[i].source == source) return 1;
+    }
+    return 0;
+}
+
+static ProcCompare resolve_comparator(int mode) {
+    int col = sort_column(mode);
+    if (col >= 0) return PROC_COLUMNS[col].compare;
+    switch (mode) {
+        case SORT_CPU_DIRECT: return cmp_cpu_direct;
+        case SORT_MEM: return cmp_mem;
+        case SORT_PID: return cmp_pid;
+        case SORT_NAME: return cmp_name;
+        case SORT_CPU_LAZY:
+        default: return cmp_cpu_lazy;
+    }
+}
+
+/* Scratch space for sort_rows(): a merge buffer and the run stack */
+typedef struct {
+    int *tmp;
+    int *runs;
+    int capacity;
+} SortScratch;
+
+#define SORT_MIN_RUN 32
+
+static int sort_scratch_reserve(SortScratch *sc, int n) {
+    if (n <= sc->capacity) return 0;
+    int *tmp = realloc(sc->tmp, sizeof(int) * n);
+    if (!tmp) return -1;
+    sc->tmp = tmp;
+    int *runs = realloc(sc->runs, sizeof(int) * (n / SORT_MIN_RUN + 2));
+    if (!runs) return -1;
+    sc->runs = runs;
+    sc->capacity = n;
+    return 0;
+}
+
+static void insertion_sort_rows(int *rows, int lo, int start, int hi,
+                                const ProcessInfo *procs, ProcCompare cmp) {
+    for (int i = start; i < hi; i++) {
+        int v = rows[i];
+        int j = i;
+        while (j > lo && cmp(&procs[v], &procs[rows[j - 1]]) < 0) {
+            rows[j] = rows[j - 1];
+            j--;
+        }
+        rows[j] = v;
+    }
+}
+
+/* Adaptive (natural) merge sort of row indices. Existing ascending runs are
+ * kept, descending ones reversed, short runs padded to SORT_MIN_RUN with
+ * insertion sort, then neighbouring runs merged. Input that is already
+ * nearly sorted - last tick's order - costs close to O(n) comparisons. */
+static void sort_rows(int *rows, int n, const ProcessInfo *procs, ProcCompare cmp, SortScratch *sc) {
+    if (n < 2) return;
+    if (sort_scratch_reserve(sc, n) != 0) {
+        insertion_sort_rows(rows, 0, 1, n, procs, cmp);
+        return;
+    }
+    
+    /* Split into runs; runs[] holds each run's start, terminated by n */
+    int num_runs = 0;
+    int i = 0;
+    while (i < n) {
+        int start = i++;
+        if (i < n && cmp(&procs[rows[i]], &procs[rows[start]]) < 0) {
+            while (i < n && cmp(&procs[rows[i]], &procs[rows[i - 1]]) < 0) i++;
+            for (int l = start, r = i - 1; l < r; l++, r--) {
+                int t = rows[l];
+                rows[l] = rows[r];
+                rows[r] = t;
+            }
+        } else {
+            while (i < n && cmp(&procs[rows[i]], &procs[rows[i - 1]]) >= 0) i++;
+        }
+        if (i - start < SORT_MIN_RUN && i < n) {
+            int end = start + SORT_MIN_RUN < n ? start + SORT_MIN_RUN : n;
+            insertion_sort_rows(rows, start, i, end, procs, cmp);
+            i = end;
+        }
+        sc->runs[num_runs++] = start;
+    }
+    sc->runs[num_runs] = n;
+    
+    /* Merge neighbouring runs pairwise until one is left */
+    while (num_runs > 1) {
+        int out = 0;
+        for (int r = 0; r < num_runs; r += 2) {
+            int lo = sc->runs[r];
+            if (r + 1 == num_runs) {
+                sc->runs[out++] = lo;
+                break;
+            }
+            int mid = sc->runs[r + 1];
+            int hi = sc->runs[r + 2];
+            sc->runs[out++] = lo;
+            if (cmp(&procs[rows[mid - 1]], &procs[rows[mid]]) <= 0) continue;
+            
+            int a = lo, b = mid, k = 0;
+            while (a < mid && b < hi) {
+                sc->tmp[k++] = cmp(&procs[rows[b]], &procs[rows[a]]) < 0 ? rows[b++] : rows[a++];
+            }
+            while (a < mid) sc->tmp[k++] = rows[a++];
+            memcpy(rows + lo, sc->tmp, sizeof(int) * k);
+        }
+        sc->runs[out] = n;
+        num_runs = out;
+    }
+}
+
+static void sift_down(int *heap, int k, int i, const ProcessInfo *procs, ProcCompare cmp) {
+    for (;;) {
+        int largest = i;
+        int l = 2 * i + 1, r = l + 1;
+        if (l < k && cmp(&procs[heap[l]], &procs[heap[largest]]) > 0) largest = l;
+        if (r < k && cmp(&procs[heap[r]], &procs[heap[largest]]) > 0) largest = r;
+        if (largest == i) return;
+        int t = heap[i];
+        heap[i] = heap[largest];
+        heap[largest] = t;
+        i = largest;
+    }
+}
+
+/* Move the first `k` rows (in comparator order) to the front of `rows` using a
+ * bounded max-heap, O(n log k); the rest of the array is left unordered */
+static void select_top_rows(int *rows, int n, int k, const ProcessInfo *procs, ProcCompare cmp) {
+    for (int i = k / 2 - 1; i >= 0; i--) sift_down(rows, k, i, procs, cmp);
+    for (int j = k; j < n; j++) {
+        if (cmp(&procs[rows[j]], &procs[rows[0]]) < 0) {
+            int t = rows[0];
+            rows[0] = rows[j];
+            rows[j] = t;
+            sift_down(rows, k, 0, procs, cmp);
+        }
+    }
+}
+
+static SortScratch g_sort_scratch;
+
+/* Display state of the process list, owned by the UI thread. It outlives the
+ * snapshots it is built on: when a new process table arrives, the order is
+ * carried over by PID so the next sort starts nearly sorted. */
+typedef struct {
+    int *order;                 /* Display order: row -> index into processes */
+    int *pids;                  /* PID of each row, saved before a snapshot swap */
+    unsigned char *placed;
+    const struct ProcDetail **details;  /* Per process index; NULL until fetched */
+    int capacity;               /* Of each array above */
+    int count;                  /* Rows in order */
+    int sorted_count;           /* Rows [0, sorted_count) of order are sorted */
+    int order_mode;             /* Sort mode the order was built for */
+    PidIndex index;             /* PID -> index into the shown process table */
+} ProcView;
+
+static ProcView g_view = { .order_mode = -1 };
+
+static int reserve_view(int need) {
+    if (need <= g_view.capacity) return 0;
+    int new_cap = g_view.capacity > 0 ? g_view.capacity : 1024;
+    while (new_cap < need) new_cap *= 2;
+    
+    int *order = realloc(g_view.order, sizeof(int) * new_cap);
+    if (!order) return -1;
+    g_view.order = order;
+    int *pids = realloc(g_view.pids, sizeof(int) * new_cap);
+    if (!pids) return -1;
+    g_view.pids = pids;
+    unsigned char *placed = realloc(g_view.placed, new_cap);
+    if (!placed) return -1;
+    g_view.placed = placed;
+    const struct ProcDetail **details = realloc(g_view.details, sizeof(*details) * new_cap);
+    if (!details) return -1;
+    g_view.details = details;
+    g_view.capacity = new_cap;
+    return 0;
+}
+
+/* Make sure rows [0, upto) of the display order are sorted. Only the top
+ * screenful (plus scroll offset) is selected when there is no usable earlier
+ * order; scrolling past it falls back to sorting everything. */
+static void ensure_sorted(int upto) {
+    int n = g_view.count;
+    if (upto > n) upto = n;
+    if (upto <= g_view.sorted_count) return;
+    
+    sort_rows(g_view.order, n, g_stats.processes, resolve_comparator(g_sort_mode), &g_sort_scratch);
+    g_view.sorted_count = n;
+}
+
+/* Process tree of the shown table, built on the UI thread from ppid. Parents
+ * are found through the view's PID index, and children are laid out
+ * contiguously (CSR) in display order, so siblings come out sorted and a
+ * build is O(n). The build runs once per process table or sort change;
+ * collapsing a subtree only walks the tree again. */
+#define TREE_COLLAPSED 1
+#define TREE_HIDDEN 2           /* An ancestor is collapsed */
+#define TREE_VISITED 4
+
+typedef struct {
+    int *rows;                  /* Display order: row -> index into processes */
+    int *parent;                /* Per process: parent's index, -1 for roots */
+    int *child_start;           /* Children of i: child_list[child_start[i]..child_start[i + 1]) */
+    int *child_list;
+    int *walk;                  /* Preorder of all processes */
+    int *stack;
+    unsigned short *depth;      /* Per process */
+    unsigned char *flags;       /* Per process, TREE_* */
+    float *cpu;                 /* Per process: CPU% of its whole subtree */
+    long *mem;                  /* Per process: RSS (KiB) of its whole subtree */
+    int capacity;
+    int count;                  /* Rows; below the process count while subtrees are collapsed */
+} ProcTree;
+
+static ProcTree g_tree;
+
+/* A few PIDs the user picked (collapsed subtrees, expanded threads). It
+ * outlives process tables and stays short, so it is a plain array. */
+typedef struct {
+    int *pids;
+    int count;
+    int capacity;
+} PidSet;
+
+static PidSet g_collapsed;
+static PidSet g_thread_expanded;
+
+static int pid_set_find(const PidSet *set, int pid) {
+    for (int k = 0; k < set->count; k++) {
+        if (set->pids[k] == pid) return k;
+    }
+    return -1;
+}
+
+/* Add (1), remove (0) or toggle (-1) `pid`. Returns 1 if the set changed. */
+static int pid_set_update(PidSet *set, int pid, int add) {
+    int k = pid_set_find(set, pid);
+    if (add < 0) add = k < 0;
+    if (add == (k >= 0)) return 0;
+    
+    if (!add) {
+        set->pids[k] = set->pids[--set->count];
+        return 1;
+    }
+    if (set->count == set->capacity) {
+        int new_cap = set->capacity > 0 ? set->capacity * 2 : 16;
+        int *pids = realloc(set->pids, sizeof(int) * new_cap);
+        if (!pids) return 0;
+        set->pids = pids;
+        set->capacity = new_cap;
+    }
+    set->pids[set->count++] = pid;
+    return 1;
+}
+
+/* Forget PIDs that are not in the shown table anymore */
+static void pid_set_prune(PidSet *set) {
+    int kept = 0;
+    for (int k = 0; k < set->count; k++) {
+        int i = pid_index_find(&g_view.index, set->pids[k]);
+        if (i >= 0 && i < g_view.count) set->pids[kept++] = set->pids[k];
+    }
+    set->count = kept;
+}
+
+static int reserve_tree(int need) {
+    if (need <= g_tree.capacity) return 0;
+    int new_cap = g_tree.capacity > 0 ? g_tree.capacity : 1024;
+    while (new_cap < need) new_cap *= 2;
+    
+    int *rows = realloc(g_tree.rows, sizeof(int) * new_cap);
+    if (!rows) return -1;
+    g_tree.rows = rows;
+    int *parent = realloc(g_tree.parent, sizeof(int) * new_cap);
+    if (!parent) return -1;
+    g_tree.parent = parent;
+    int *child_start = realloc(g_tree.child_start, sizeof(int) * (new_cap + 1));
+    if (!child_start) return -1;
+    g_tree.child_start = child_start;
+    int *child_list = realloc(g_tree.child_list, sizeof(int) * new_cap);
+    if (!child_list) return -1;
+    g_tree.child_list = child_list;
+    int *walk = realloc(g_tree.walk, sizeof(int) * new_cap);
+    if (!walk) return -1;
+    g_tree.walk = walk;
+    int *stack = realloc(g_tree.stack, sizeof(int) * new_cap);
+    if (!stack) return -1;
+    g_tree.stack = stack;
+    unsigned short *depth = realloc(g_tree.depth, sizeof(unsigned short) * new_cap);
+    if (!depth) return -1;
+    g_tree.depth = depth;
+    unsigned char *flags = realloc(g_tree.flags, new_cap);
+    if (!flags) return -1;
+    g_tree.flags = flags;
+    float *cpu = realloc(g_tree.cpu, sizeof(float) * new_cap);
+    if (!cpu) return -1;
+    g_tree.cpu = cpu;
+    long *mem = realloc(g_tree.mem, sizeof(long) * new_cap);
+    if (!mem) return -1;
+    g_tree.mem = mem;
+    g_tree.capacity = new_cap;
+    return 0;
+}
+
+static inline int tree_has_children(int i) {
+    return g_tree.child_start[i + 1] > g_tree.child_start[i];
+}
+
+/* Walk the subtree of `root` in preorder, appending every process to walk
+ * and the ones not under a collapsed node to rows. Returns the walk length. */
+static int tree_walk(int root, int walked) {
+    ProcTree *t = &g_tree;
+    int top = 0;
+    t->stack[top++] = root;
+    while (top > 0) {
+        int i = t->stack[--top];
+        int p = t->parent[i];
+        t->flags[i] |= TREE_VISITED;
+        t->walk[walked++] = i;
+        t->depth[i] = p < 0 ? 0 : t->depth[p] < USHRT_MAX ? t->depth[p] + 1 : USHRT_MAX;
+        if (p >= 0 && (t->flags[p] & (TREE_COLLAPSED | TREE_HIDDEN))) t->flags[i] |= TREE_HIDDEN;
+        else t->rows[t->count++] = i;
+        /* Every process is in one child list, so the stack never exceeds n */
+        for (int c = t->child_start[i + 1] - 1; c >= t->child_start[i]; c--) {
+            if (!(t->flags[t->child_list[c]] & TREE_VISITED)) t->stack[top++] = t->child_list[c];
+        }
+    }
+    return walked;
+}
+
+/* Lay out the rows of the tree view, after a collapse changed */
+static void tree_layout(void) {
+    ProcTree *t = &g_tree;
+    int n = g_view.count;
+    
+    for (int i = 0; i < n; i++) t->flags[i] = 0;
+    pid_set_prune(&g_collapsed);
+    for (int k = 0; k < g_collapsed.count; k++) {
+        t->flags[pid_index_find(&g_view.index, g_collapsed.pids[k])] |= TREE_COLLAPSED;
+    }
+    
+    /* Roots in display order; processes only reachable through a ppid cycle
+     * are walked last, as roots of their own */
+    t->count = 0;
+    int walked = 0;
+    for (int r = 0; r < n; r++) {
+        int i = g_view.order[r];
+        if (t->parent[i] < 0) walked = tree_walk(i, walked);
+    }
+    for (int r = 0; r < n && walked < n; r++) {
+        int i = g_view.order[r];
+        if (t->flags[i] & TREE_VISITED) continue;
+        t->parent[i] = -1;
+        walked = tree_walk(i, walked);
+    }
+}
+
+/* Rebuild the tree of the shown table: parent links, child lists in display
+ * order, rows, and subtree totals (children before parents, by walking the
+ * preorder backwards) */
+static void tree_build(void) {
+    ProcTree *t = &g_tree;
+    int n = g_view.count;
+    if (reserve_tree(n) != 0) {
+        g_tree_view = 0;
+        return;
+    }
+    ensure_sorted(n);
+    
+    /* A parent that started after its child is a reused PID */
+    const ProcessInfo *procs = g_stats.processes;
+    memset(t->child_start, 0, sizeof(int) * (n + 1));
+    for (int i = 0; i < n; i++) {
+        int p = pid_index_find(&g_view.index, procs[i].ppid);
+        if (p >= n || p == i || (p >= 0 && procs[p].starttime > procs[i].starttime)) p = -1;
+        t->parent[i] = p;
+        if (p >= 0) t->child_start[p + 1]++;
+    }
+    for (int i = 0; i < n; i++) t->child_start[i + 1] += t->child_start[i];
+    
+    /* rows is free until the layout; it holds each list's fill position */
+    for (int i = 0; i < n; i++) t->rows[i] = t->child_start[i];
+    for (int r = 0; r < n; r++) {
+        int i = g_view.order[r];
+        if (t->parent[i] >= 0) t->child_list[t->rows[t->parent[i]]++] = i;
+    }
+    
+    tree_layout();
+    
+    for (int i = 0; i < n; i++) {
+        t->cpu[i] = procs[i].cpu_percent;
+        t->mem[i] = procs[i].mem_rss;
+    }
+    for (int k = n - 1; k >= 0; k--) {
+        int i = t->walk[k];
+        if (t->parent[i] < 0) continue;
+        t->cpu[t->parent[i]] += t->cpu[i];
+        t->mem[t->parent[i]] += t->mem[i];
+    }
+}
+
+/* Display rows with the threads of expanded processes spliced in under
+ * them; only in use while the shown table has threads */
+static struct {
+    int *index;                 /* Row -> index into processes */
+    int *thread;                /* Row -> index into threads; -1 for process rows */
+    int *group;                 /* Per process: its first thread, or -1 */
+    int capacity;
+    int group_capacity;
+    int count;
+    int active;
+} g_rows;
+
+static void rows_build(void);
+
+/* Collapse (1), expand (0) or toggle (-1) the subtree of `pid` */
+static void tree_set_collapsed(int pid, int collapse) {
+    if (!pid_set_update(&g_collapsed, pid, collapse)) return;
+    tree_layout();
+    rows_build();
+}
+
+/* Build the display order of the shown process table from scratch: rows up
+ * to one page past the visible window come from a top-K selection and the
+ * rest is only sorted if the user scrolls there. The tree view needs all of
+ * it sorted. */
+void sort_processes(void) {
+    int n = g_view.count;
+    ProcCompare cmp = resolve_comparator(g_sort_mode);
+    
+    g_view.order_mode = g_sort_mode;
+    for (int i = 0; i < n; i++) g_view.order[i] = i;
+    g_view.sorted_count = 0;
+    
+    int rows = g_proc_rows > 0 ? g_proc_rows : 50;
+    int k = g_scroll_offset + 2 * rows;
+    if (g_selected_process + 1 > k) k = g_selected_process + 1;
+    
+    if (g_tree_view) {
+        tree_build();
+    } else if (k * 4 >= n) {
+        ensure_sorted(n);
+    } else {
+        select_top_rows(g_view.order, n, k, g_stats.processes, cmp);
+        sort_rows(g_view.order, k, g_stats.processes, cmp, &g_sort_scratch);
+        g_view.sorted_count = k;
+    }
+    rows_build();
+}
+
+/* Remember which PID each row shows; the process table they index into is
+ * handed back to the collector when the next snapshot is adopted */
+static void view_save_pids(void) {
+    for (int r = 0; r < g_view.count; r++) {
+        g_view.pids[r] = g_stats.processes[g_view.order[r]].pid;
+    }
+}
+
+/* Re-target the view at a new process table. The previous order is replayed
+ * by PID; exited processes drop out and new ones are appended, and the
+ * adaptive merge sort repairs the result in close to O(n). Without a usable
+ * earlier order (first table, sort mode changed) a top-K order is built. */
+static void view_remap(void) {
+    int prev_rows = g_view.count;
+    int n = g_stats.process_count;
+    if (reserve_view(n) != 0) {
+        n = g_stats.process_count = g_view.capacity < n ? g_view.capacity : n;
+    }
+    g_view.count = n;
+    for (int i = 0; i < n; i++) g_view.details[i] = NULL;
+    
+    int have_index = (pid_index_reset(&g_view.index, n) == 0);
+    if (have_index) {
+        for (int i = 0; i < n; i++) pid_index_insert(&g_view.index, g_stats.processes[i].pid, i);
+    }
+    
+    if (!have_index || g_view.order_mode != g_sort_mode) {
+        sort_processes();
+        return;
+    }
+    
+    memset(g_view.placed, 0, n);
+    int k = 0;
+    for (int r = 0; r < prev_rows; r++) {
+        int i = pid_index_find(&g_view.index, g_view.pids[r]);
+        if (i < 0 || g_view.placed[i]) continue;
+        g_view.order[k++] = i;
+        g_view.placed[i] = 1;
+    }
+    for (int i = 0; i < n; i++) {
+        if (!g_view.placed[i]) g_view.order[k++] = i;
+    }
+    sort_rows(g_view.order, n, g_stats.processes, resolve_comparator(g_sort_mode), &g_sort_scratch);
+    g_view.sorted_count = n;
+    if (g_tree_view) tree_build();
+    rows_build();
+}
+
+/* Rows of the process list, before and after threads are spliced in */
+static inline int base_rows(void) {
+    return g_tree_view ? g_tree.count : g_view.count;
+}
+
+static inline int base_index(int row) {
+    return g_tree_view ? g_tree.rows[row] : g_view.order[row];
+}
+
+static inline int view_rows(void) {
+    return g_rows.active ? g_rows.count : base_rows();
+}
+
+/* Index into processes of display row `row`; for a thread row, its process */
+static inline int view_index(int row) {
+    return g_rows.active ? g_rows.index[row] : base_index(row);
+}
+
+/* Index into threads of display row `row`, or -1 if it shows a process */
+static inline int view_thread(int row) {
+    return g_rows.active ? g_rows.thread[row] : -1;
+}
+
+static int reserve_rows(int rows, int procs) {
+    if (rows > g_rows.capacity) {
+        int new_cap = g_rows.capacity > 0 ? g_rows.capacity : 1024;
+        while (new_cap < rows) new_cap *= 2;
+        int *index = realloc(g_rows.index, sizeof(int) * new_cap);
+        if (!index) return -1;
+        g_rows.index = index;
+        int *thread = realloc(g_rows.thread, sizeof(int) * new_cap);
+        if (!thread) return -1;
+        g_rows.thread = thread;
+        g_rows.capacity = new_cap;
+    }
+    if (procs > g_rows.group_capacity) {
+        int *group = realloc(g_rows.group, sizeof(int) * procs);
+        if (!group) return -1;
+        g_rows.group = group;
+        g_rows.group_capacity = procs;
+    }
+    return 0;
+}
+
+/* Splice the threads of the shown table under their processes. Threads come
+ * grouped by process, and only for processes that were expanded when they
+ * were sampled; one collapsed since is skipped right away. */
+static void rows_build(void) {
+    g_rows.active = 0;
+    int n = g_view.count;
+    if (g_stats.thread_count == 0 || reserve_rows(base_rows() + g_stats.thread_count, n) != 0) return;
+    if (!g_tree_view) ensure_sorted(n);
+    
+    for (int i = 0; i < n; i++) g_rows.group[i] = -1;
+    for (int t = 0; t < g_stats.thread_count; t++) {
+        if (t > 0 && g_stats.threads[t].pid == g_stats.threads[t - 1].pid) continue;
+        int i = pid_index_find(&g_view.index, g_stats.threads[t].pid);
+        if (i >= 0 && i < n) g_rows.group[i] = t;
+    }
+    
+    pid_set_prune(&g_thread_expanded);
+    int rows = 0;
+    for (int r = 0; r < base_rows(); r++) {
+        int i = base_index(r);
+        g_rows.index[rows] = i;
+        g_rows.thread[rows++] = -1;
+        int t = g_rows.group[i];
+        if (t < 0 || (!g_show_threads && pid_set_find(&g_thread_expanded, g_stats.processes[i].pid) < 0)) continue;
+        for (; t < g_stats.thread_count && g_stats.threads[t].pid == g_stats.processes[i].pid; t++) {
+            g_rows.index[rows] = i;
+            g_rows.thread[rows++] = t;
+        }
+    }
+    g_rows.count = rows;
+    g_rows.active = 1;
+}
+
+/* Process shown at display row `row` */
+static inline ProcessInfo *proc_at(int row) {
+    return &g_stats.processes[view_index(row)];
+}
+
+/* Display row of `pid`, or -1. The flat order is sorted in full first:
+ * a row in the unsorted tail would be reordered under the caller. */
+static int view_find_row(int pid) {
+    if (!g_tree_view) ensure_sorted(g_view.count);
+    int rows = view_rows();
+    for (int r = 0; r < rows; r++) {
+        if (proc_at(r)->pid == pid) return r;
+    }
+    return -1;
+}
+
+/* /proc walker: holds one dirfd for /proc across ticks, reads directory
+ * entries in large getdents64 batches and reads per-PID files relative to
+ * a per-PID dirfd with a single read() into a reusable buffer. */
+#define SCAN_DENTS_SIZE 32768
+#define SCAN_BUF_SIZE 4096
+
+typedef struct {
+    int proc_fd;
+    char *dents;
+    long dents_len;
+    long dents_pos;
+#ifndef __linux__
+    DIR *dir;
+#endif
+    char buf[SCAN_BUF_SIZE];
+} ProcScanner;
+
+#ifdef __linux__
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+static ProcScanner g_scanner = { .proc_fd = -1 };
+
+/* Open /proc once and rewind it for a new pass */
+static int proc_scan_begin(ProcScanner *sc) {
+    if (sc->proc_fd < 0) {
+        sc->proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (sc->proc_fd < 0) return -1;
+#ifdef __linux__
+        sc->dents = malloc(SCAN_DENTS_SIZE);
+        if (!sc->dents) {
+            close(sc->proc_fd);
+            sc->proc_fd = -1;
+            return -1;
+        }
+#else
+        sc->dir = fdopendir(dup(sc->proc_fd));
+        if (!sc->dir) {
+            close(sc->proc_fd);
+            sc->proc_fd = -1;
+            return -1;
+        }
+#endif
+    }
+#ifdef __linux__
+    lseek(sc->proc_fd, 0, SEEK_SET);
+    sc->dents_len = 0;
+    sc->dents_pos = 0;
+#else
+    rewinddir(sc->dir);
+#endif
+    return 0;
+}
+
+/* Returns the next numeric /proc entry name, or NULL at the end of the pass */
+static const char *proc_scan_next(ProcScanner *sc) {
+#ifdef __linux__
+    for (;;) {
+        if (sc->dents_pos >= sc->dents_len) {
+            long n = syscall(SYS_getdents64, sc->proc_fd, sc->dents, SCAN_DENTS_SIZE);
+            if (n <= 0) return NULL;
+            sc->dents_len = n;
+            sc->dents_pos = 0;
+        }
+        struct linux_dirent64 *d = (struct linux_dirent64 *)(sc->dents + sc->dents_pos);
+        sc->dents_pos += d->d_reclen;
+        if (d->d_name[0] >= '1' && d->d_name[0] <= '9' && is_number(d->d_name)) {
+            return d->d_name;
+        }
+    }
+#else
+    struct dirent *entry;
+    while ((entry = readdir(sc->dir)) != NULL) {
+        if (entry->d_name[0] >= '1' && entry->d_name[0] <= '9' && is_number(entry->d_name)) {
+            return entry->d_name;
+        }
+    }
+    return NULL;
+#endif
+}
+
+/* Fields that only change on exec, cached per (pid, starttime) */
+typedef struct ProcDetail {
+    char comm[64];          /* comm when fetched; a change means the process exec'd */
+    char cmdline[512];
+    char user[32];
+    int uid;                /* -1 if unknown */
+} ProcDetail;
+
+typedef struct ReadJob ReadJob;
+
+/* Per-PID cache that persists across ticks. It keeps /proc/<pid>/stat and
+ * status open so long-lived processes are re-read with pread(), and holds the
+ * exec-time fields so cmdline and the username are not re-fetched every tick.
+ * A cached fd stays bound to the process it was opened for, so reads of an
+ * exited (or reused) PID fail with ESRCH and the entry is reopened or dropped.
+ * There are two instances, one per thread: the collector's holds the stat fds,
+ * the UI's holds the details and the status fds of focused processes. */
+typedef struct {
+    int pid;
+    int stat_fd;
+    int status_fd;
+    int sched_fd;
+    int io_fd;
+    unsigned int pass;      /* scan pass that last saw this PID */
+    unsigned long long starttime;
+    ProcDetail *detail;
+    int detail_valid;       /* cleared when an exec or PID reuse is seen */
+    unsigned int ident_seq; /* Collector: exec/uid events seen; UI: value when fetched */
+    unsigned long long delay_ns[NUM_DELAYS];    /* Collector: last taskstats totals */
+    int64_t delay_stamp_ms;                     /* When they were read; 0 if never */
+    ReadJob *read_job;      /* UI: detail read still out on a reader thread */
+    int64_t quarantine_ms;  /* UI: no new detail reads before this time */
+    unsigned int detail_generation;     /* UI: proc_generation of the last read */
+} ProcCacheEntry;
+
+typedef struct {
+    ProcCacheEntry *entries;
+    int count;
+    int capacity;
+    PidIndex index;
+    int open_fds;
+    int budget;             /* fds the cache may hold; -1 until computed */
+    unsigned int pass;
+    int proc_fd;            /* /proc dirfd the per-PID files are opened from */
+} ProcCache;
+
+static ProcCache g_proc_cache = { .budget = -1, .proc_fd = -1 };
+static ProcCache g_detail_cache = { .budget = -1, .proc_fd = -1 };
+
+/* Size the fd budget from the configured limit and RLIMIT_NOFILE, raising the
+ * soft limit toward the hard limit if the configured budget needs it.
+ * `reserve` fds are left for everything that is not cached. */
+static void proc_cache_init_budget(ProcCache *pc, long reserve) {
+    long budget = g_fd_cache_limit;
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+        rlim_t want = (rlim_t)(budget + reserve);
+        if (rl.rlim_cur != RLIM_INFINITY && rl.rlim_cur < want) {
+            struct rlimit raised = rl;
+            raised.rlim_cur = (rl.rlim_max == RLIM_INFINITY || rl.rlim_max > want) ? want : rl.rlim_max;
+            if (setrlimit(RLIMIT_NOFILE, &raised) == 0) rl = raised;
+        }
+        if (rl.rlim_cur != RLIM_INFINITY && (long)rl.rlim_cur - reserve < budget) {
+            budget = (long)rl.rlim_cur - reserve;
+        }
+    }
+    pc->budget = budget > 0 ? (int)budget : 0;
+}
+
+static void proc_cache_rebuild_index(ProcCache *pc, int min_count) {
+    if (pid_index_reset(&pc->index, min_count) != 0) return;
+    for (int i = 0; i < pc->count; i++) {
+        pid_index_insert(&pc->index, pc->entries[i].pid, i);
+    }
+}
+
+/* Find or create the entry for `pid` and mark it seen in the current pass.
+ * The returned pointer is valid until the next call. */
+static ProcCacheEntry *proc_cache_get(ProcCache *pc, int pid) {
+    int i = pid_index_find(&pc->index, pid);
+    if (i < 0) {
+        if (pc->count == pc->capacity) {
+            int new_cap = pc->capacity > 0 ? pc->capacity * 2 : 1024;
+            ProcCacheEntry *grown = realloc(pc->entries, sizeof(ProcCacheEntry) * new_cap);
+            if (!grown) return NULL;
+            pc->entries = grown;
+            pc->capacity = new_cap;
+        }
+        if ((unsigned int)(pc->count + 1) * 2 > pc->index.capacity) {
+            proc_cache_rebuild_index(pc, pc->capacity);
+            if ((unsigned int)(pc->count + 1) * 2 > pc->index.capacity) return NULL;
+        }
+        i = pc->count++;
+        pc->entries[i].pid = pid;
+        pc->entries[i].stat_fd = -1;
+        pc->entries[i].status_fd = -1;
+        pc->entries[i].sched_fd = -1;
+        pc->entries[i].io_fd = -1;
+        pc->entries[i].starttime = 0;
+        pc->entries[i].detail = NULL;
+        pc->entries[i].detail_valid = 0;
+        pc->entries[i].ident_seq = 0;
+        pc->entries[i].delay_stamp_ms = 0;
+        pc->entries[i].read_job = NULL;
+        pc->entries[i].quarantine_ms = 0;
+        pc->entries[i].detail_generation = 0;
+        pid_index_insert(&pc->index, pid, i);
+    }
+    pc->entries[i].pass = pc->pass;
+    return &pc->entries[i];
+}
+
+/* open_fds is shared by the scan workers, hence the atomics */
+static void proc_cache_close_fd(ProcCache *pc, int *fd) {
+    if (*fd < 0) return;
+    close(*fd);
+    *fd = -1;
+    __atomic_sub_fetch(&pc->open_fds, 1, __ATOMIC_RELAXED);
+}
+
+/* Drop entries for PIDs that were not seen in the last pass */
+static void proc_cache_sweep(ProcCache *pc) {
+    int kept = 0;
+    for (int i = 0; i < pc->count; i++) {
+        ProcCacheEntry *e = &pc->entries[i];
+        if (e->pass != pc->pass) {
+            proc_cache_close_fd(pc, &e->stat_fd);
+            proc_cache_close_fd(pc, &e->status_fd);
+            proc_cache_close_fd(pc, &e->sched_fd);
+            proc_cache_close_fd(pc, &e->io_fd);
+            free(e->detail);
+            continue;
+        }
+        pc->entries[kept++] = *e;
+    }
+    if (kept != pc->count) {
+        pc->count = kept;
+        proc_cache_rebuild_index(pc, kept);
+    }
+}
+
+/* Read `file` of one PID through its cached fd, opening it (and the per-PID
+ * dirfd, lazily) when there is none. The fd is kept if the budget allows. */
+static ssize_t cached_read(ProcCache *pc, int *fd, int *pid_fd, const char *entry_name,
+                           const char *file, char *buf, size_t size) {
+    if (*fd >= 0) {
+        ssize_t n = pread(*fd, buf, size - 1, 0);
+        if (n >= 0) {
+            buf[n] = '\0';
+            return n;
+        }
+        /* ESRCH: the process this fd belonged to is gone; the PID may be reused */
+        proc_cache_close_fd(pc, fd);
+    }
+    
+    if (*pid_fd < 0) {
+        *pid_fd = openat(pc->proc_fd, entry_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (*pid_fd < 0) return -1;
+    }
+    
+    /* Claim a budget slot first so concurrent scan workers cannot overshoot */
+    if (__atomic_add_fetch(&pc->open_fds, 1, __ATOMIC_RELAXED) > pc->budget) {
+        __atomic_sub_fetch(&pc->open_fds, 1, __ATOMIC_RELAXED);
+        return read_file_at(*pid_fd, file, buf, size);
+    }
+    
+    int nfd = openat(*pid_fd, file, O_RDONLY | O_CLOEXEC);
+    ssize_t n = nfd >= 0 ? read(nfd, buf, size - 1) : -1;
+    if (n < 0) {
+        if (nfd >= 0) close(nfd);
+        __atomic_sub_fetch(&pc->open_fds, 1, __ATOMIC_RELAXED);
+        return -1;
+    }
+    buf[n] = '\0';
+    *fd = nfd;
+    return n;
+}
+
+/* Reading status or cmdline can block for seconds while the target process
+ * holds its mmap_lock, which is common under heavy swapping. The UI thread
+ * therefore never reads them itself: a few reader threads do, and the UI waits
+ * at most DETAIL_DEADLINE_MS per frame for the reads it handed out. A read that
+ * misses the deadline is left to finish in the background; until it does, its
+ * PID is shown as unreadable and no new read of it is started (quarantine). */
+#define READER_THREADS 2        /* Readers kept free of stuck reads */
+#define READER_MAX 16
+#define DETAIL_DEADLINE_MS 50
+#define DETAIL_QUARANTINE_MS 10000  /* No new reads of a PID after a timeout */
+
+struct ReadJob {
+    ReadJob *next;
+    int pid;
+    int keep_fd;
+    int status_fd;          /* Moved out of the cache entry while the job is out */
+    char comm[64];
+    ProcDetail detail;      /* Result */
+    int running;
+    int done;
+    int abandoned;          /* The UI stopped waiting before it was done */
+    int refs;               /* Held by the UI and by the queue or a reader */
+};
+
+/* All fields, and the jobs' state flags, are guarded by lock */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    ReadJob *head, *tail;
+    int threads;
+    int stuck;              /* Readers inside an abandoned read */
+} g_reader = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, NULL, 0, 0 };
+
+static const ProcDetail g_unreadable_detail = { "", "(unreadable: /proc read timed out)", "?", -1 };
+
+/* Read the exec-time fields of one process on a reader thread: uid from
+ * status, and cmdline. Only a process refreshed on every tick (`keep_fd`)
+ * holds its status fd open; for the rest it would just eat the fd budget. */
+static void proc_detail_read(ReadJob *job) {
+    ProcCache *pc = &g_detail_cache;
+    ProcDetail *d = &job->detail;
+    char entry_name[16], buf[SCAN_BUF_SIZE];
+    int pid_fd = -1;
+    snprintf(entry_name, sizeof(entry_name), "%d", job->pid);
+    memcpy(d->comm, job->comm, sizeof(d->comm));
+    
+    /* Parse Uid line: "Uid: 1000 1000 1000 1000"; -1 if status is unreadable */
+    d->uid = -1;
+    ssize_t got;
+    if (job->keep_fd || job->status_fd >= 0) {
+        got = cached_read(pc, &job->status_fd, &pid_fd, entry_name, "status", buf, sizeof(buf));
+    } else {
+        pid_fd = openat(pc->proc_fd, entry_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        got = pid_fd >= 0 ? read_file_at(pid_fd, "status", buf, sizeof(buf)) : -1;
+    }
+    if (got > 0) {
+        char *uid_line = strstr(buf, "\nUid:");
+        if (uid_line) {
+            const char *p = uid_line + 5;
+            d->uid = (int)tok_ll(&p);
+        }
+    }
+    /* Resolved here rather than on the UI thread, as NSS may block */
+    if (d->uid < 0) snprintf(d->user, sizeof(d->user), "?");
+    else get_username(d->uid, d->user, sizeof(d->user));
+
+    ssize_t n = -1;
+    if (pid_fd < 0) {
+        pid_fd = openat(pc->proc_fd, entry_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    }
+    if (pid_fd >= 0) {
+        n = read_file_at(pid_fd, "cmdline", d->cmdline, sizeof(d->cmdline));
+        close(pid_fd);
+    }
+    for (ssize_t i = 0; i < n; i++) {
+        if (d->cmdline[i] == '\0') d->cmdline[i] = ' ';
+    }
+    if (n <= 0) {
+        memcpy(d->cmdline, d->comm, sizeof(d->comm));
+    }
+}
+
+static void read_job_put(ReadJob *job) {
+    if (--job->refs > 0) return;
+    proc_cache_close_fd(&g_detail_cache, &job->status_fd);
+    free(job);
+}
+
+/* The UI gives up on a job; a reader inside it counts as stuck */
+static void read_job_abandon(ReadJob *job) {
+    if (job->done || job->abandoned) return;
+    job->abandoned = 1;
+    if (job->running) g_reader.stuck++;
+}
+
+static void *reader_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_reader.lock);
+    for (;;) {
+        while (!g_reader.head) pthread_cond_wait(&g_reader.work, &g_reader.lock);
+        ReadJob *job = g_reader.head;
+        g_reader.head = job->next;
+        if (!g_reader.head) g_reader.tail = NULL;
+        job->running = 1;
+        if (job->abandoned) g_reader.stuck++;
+        pthread_mutex_unlock(&g_reader.lock);
+        
+        proc_detail_read(job);
+        
+        pthread_mutex_lock(&g_reader.lock);
+        job->done = 1;
+        if (job->abandoned) g_reader.stuck--;
+        read_job_put(job);
+        pthread_cond_broadcast(&g_reader.done);
+        
+        /* Replacements spawned while this reader was stuck are enough now */
+        if (!g_reader.head && g_reader.threads - g_reader.stuck > READER_THREADS) break;
+    }
+    g_reader.threads--;
+    pthread_mutex_unlock(&g_reader.lock);
+    return NULL;
+}
+
+/* Keep READER_THREADS readers that are not stuck. A stuck reader cannot be
+ * cancelled, so it is replaced and exits on its own once its read returns. */
+static void reader_spawn(void) {
+    while (g_reader.threads - g_reader.stuck < READER_THREADS && g_reader.threads < READER_MAX) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, reader_main, NULL) != 0) break;
+        pthread_detach(thread);
+        g_reader.threads++;
+    }
+}
+
+/* Queue a detail read of one process; g_reader.lock is held */
+static void reader_submit(ProcCacheEntry *e, const char *comm, int keep_fd) {
+    reader_spawn();
+    ReadJob *job = calloc(1, sizeof(ReadJob));
+    if (!job) return;
+    job->pid = e->pid;
+    job->keep_fd = keep_fd;
+    job->status_fd = e->status_fd;
+    e->status_fd = -1;
+    size_t comm_len = strnlen(comm, sizeof(job->comm) - 1);
+    memcpy(job->comm, comm, comm_len);
+    job->refs = 2;
+    if (g_reader.tail) g_reader.tail->next = job;
+    else g_reader.head = job;
+    g_reader.tail = job;
+    pthread_cond_signal(&g_reader.work);
+    e->read_job = job;
+}
+
+/* Take over the result of a finished read; g_reader.lock is held */
+static void detail_apply(ProcCacheEntry *e) {
+    ReadJob *job = e->read_job;
+    e->read_job = NULL;
+    if (!e->detail) e->detail = malloc(sizeof(ProcDetail));
+    if (e->detail) {
+        *e->detail = job->detail;
+        e->detail_valid = 1;
+    }
+    e->status_fd = job->status_fd;
+    job->status_fd = -1;
+    read_job_put(job);
+}
+
+/* Keep the selected process inside a window of `rows` list rows */
+static void clamp_scroll(int rows) {
+    if (g_selected_process < g_scroll_offset) {
+        g_scroll_offset = g_selected_process;
+    } else if (g_selected_process >= g_scroll_offset + rows) {
+        g_scroll_offset = g_selected_process - rows + 1;
+    }
+    if (g_scroll_offset < 0) g_scroll_offset = 0;
+}
+
+/* Reuse the cached cmdline/user for one process of the shown table, or hand
+ * out a read of them. With `focus` they are read again once per process scan
+ * so the selected process stays current. Returns the job to wait for, if
+ * any; g_reader.lock is held. */
+static ReadJob *fetch_detail(int idx, int focus) {
+    ProcessInfo *proc = &g_stats.processes[idx];
+    ProcCacheEntry *e = proc_cache_get(&g_detail_cache, proc->pid);
+    if (!e) return NULL;
+    if (e->read_job && e->read_job->done) detail_apply(e);
+    
+    /* A different starttime means PID reuse, a different comm or ident_seq an
+     * exec (ident_seq also moves on uid changes) */
+    if (e->detail_valid && (e->starttime != proc->starttime || e->ident_seq != proc->ident_seq ||
+        strncmp(e->detail->comm, proc->name, sizeof(e->detail->comm) - 1) != 0)) {
+        e->detail_valid = 0;
+    }
+    
+    int refresh = focus && e->detail_generation != g_stats.proc_generation;
+    if ((!e->detail_valid || refresh) && !e->read_job && get_time_ms() >= e->quarantine_ms) {
+        e->starttime = proc->starttime;
+        e->ident_seq = proc->ident_seq;
+        e->detail_generation = g_stats.proc_generation;
+        reader_submit(e, proc->name, focus);
+    }
+    
+    /* A job still queued from an earlier frame is waited for again */
+    ReadJob *job = e->read_job;
+    if (job && job->abandoned) {
+        g_view.details[idx] = &g_unreadable_detail;
+        return NULL;
+    }
+    g_view.details[idx] = e->detail_valid ? e->detail : NULL;
+    return job;
+}
+
+/* PIDs of the rows the UI shows, for collectors that only sample those.
+ * Written by the UI after each detail pass, copied out by the collector. */
+#define IN_VIEW_MAX 512
+
+static struct {
+    pthread_mutex_t lock;
+    int pids[IN_VIEW_MAX];
+    int count;
+    int expanded[IN_VIEW_MAX];  /* Processes whose threads are listed */
+    int expanded_count;
+} g_in_view = { PTHREAD_MUTEX_INITIALIZER, {0}, 0, {0}, 0 };
+
+static void publish_in_view(int first, int last) {
+    pthread_mutex_lock(&g_in_view.lock);
+    g_in_view.count = 0;
+    for (int i = first; i < last && g_in_view.count < IN_VIEW_MAX - 1; i++) {
+        if (view_thread(i) < 0) g_in_view.pids[g_in_view.count++] = proc_at(i)->pid;
+    }
+    if (g_selected_process >= 0 && g_selected_process < view_rows() &&
+        (g_selected_process < first || g_selected_process >= last)) {
+        g_in_view.pids[g_in_view.count++] = proc_at(g_selected_process)->pid;
+    }
+    
+    /* With threads shown globally, every process in view is expanded */
+    if (g_show_threads) {
+        memcpy(g_in_view.expanded, g_in_view.pids, sizeof(int) * g_in_view.count);
+        g_in_view.expanded_count = g_in_view.count;
+    } else {
+        g_in_view.expanded_count = 0;
+        for (int k = 0; k < g_thread_expanded.count && k < IN_VIEW_MAX; k++) {
+            g_in_view.expanded[g_in_view.expanded_count++] = g_thread_expanded.pids[k];
+        }
+    }
+    pthread_mutex_unlock(&g_in_view.lock);
+}
+
+/* Details of the process shown at display row `row`; NULL if not fetched */
+static inline const ProcDetail *detail_at(int row) {
+    return g_view.details[view_index(row)];
+}
+
+/* Phase two of the process scan, run on the UI thread: status, cmdline and
+ * the username are read only for the rows in the visible window of the
+ * process list and for the selected process, so scrolling never waits for
+ * the collector. Everything else keeps what the cache already has. */
+void fetch_visible_details(void) {
+    if (g_stats.process_count == 0) return;
+    if (g_detail_cache.proc_fd < 0) {
+        g_detail_cache.proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (g_detail_cache.proc_fd < 0) return;
+        g_detail_cache.budget = DETAIL_FD_BUDGET;
+    }
+    
+    int rows = g_proc_rows > 0 ? g_proc_rows : tb_height();
+    if (rows <= 0) rows = 50;
+    clamp_scroll(rows);
+    
+    int last = g_scroll_offset + rows;
+    if (last > view_rows()) last = view_rows();
+    ensure_sorted(last > g_selected_process ? last : g_selected_process + 1);
+    
+    ReadJob *jobs[IN_VIEW_MAX];
+    int job_idx[IN_VIEW_MAX];
+    int n = 0;
+    pthread_mutex_lock(&g_reader.lock);
+    for (int i = g_scroll_offset; i < last; i++) {
+        ReadJob *job = fetch_detail(view_index(i), i == g_selected_process);
+        if (job && n < IN_VIEW_MAX) {
+            jobs[n] = job;
+            job_idx[n++] = view_index(i);
+        }
+    }
+    if (g_selected_process >= 0 && g_selected_process < view_rows() &&
+        (g_selected_process < g_scroll_offset || g_selected_process >= last)) {
+        ReadJob *job = fetch_detail(view_index(g_selected_process), 1);
+        if (job && n < IN_VIEW_MAX) {
+            jobs[n] = job;
+            job_idx[n++] = view_index(g_selected_process);
+        }
+    }
+    
+    /* Wait for this frame's reads, but never past the deadline */
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += DETAIL_DEADLINE_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    int timed_out = 0;
+    for (int k = 0; k < n && !timed_out; k++) {
+        while (!jobs[k]->done && !timed_out) {
+            timed_out = pthread_cond_timedwait(&g_reader.done, &g_reader.lock, &deadline) == ETIMEDOUT;
+        }
+    }
+    
+    /* Late reads stay out and quarantine their PID. Jobs no reader got to
+     * yet are not the PID's fault; they stay queued for the next frame. */
+    int64_t now = get_time_ms();
+    for (int k = 0; k < n; k++) {
+        int idx = job_idx[k];
+        ProcCacheEntry *e = proc_cache_get(&g_detail_cache, jobs[k]->pid);
+        if (!e || e->read_job != jobs[k]) continue;
+        if (jobs[k]->done) {
+            detail_apply(e);
+            g_view.details[idx] = e->detail_valid ? e->detail : NULL;
+        } else if (jobs[k]->running) {
+            read_job_abandon(jobs[k]);
+            e->quarantine_ms = now + DETAIL_QUARANTINE_MS;
+            g_view.details[idx] = &g_unreadable_detail;
+        }
+    }
+    reader_spawn();
+    pthread_mutex_unlock(&g_reader.lock);
+    
+    publish_in_view(g_scroll_offset, last);
+}
+
+/* Drop cached details of processes that are not in the shown table anymore */
+static void detail_cache_retain(void) {
+    ProcCache *dc = &g_detail_cache;
+    dc->pass++;
+    for (int i = 0; i < dc->count; i++) {
+        ProcCacheEntry *e = &dc->entries[i];
+        int j = pid_index_find(&g_view.index, e->pid);
+        if (j >= 0 && j < g_stats.process_count &&
+            g_stats.processes[j].starttime == e->starttime) e->pass = dc->pass;
+        else if (e->read_job) {
+            pthread_mutex_lock(&g_reader.lock);
+            read_job_abandon(e->read_job);
+            read_job_put(e->read_job);
+            pthread_mutex_unlock(&g_reader.lock);
+            e->read_job = NULL;
+        }
+    }
+    proc_cache_sweep(dc);
+}
+
+/* State of one process scan pass, shared read-only by the scan workers except
+ * for the per-PID slots: worker i writes only processes[i] and ok[i] */
+typedef struct {
+    int *pids;
+    int *cache_slot;            /* Index into g_proc_cache.entries, or -1 */
+    unsigned char *ok;
+    int capacity;
+    const ProcessInfo *prev_procs;
+    PidIndex prev_index;
+    int have_index;
+    PidIndex sample_index;      /* g_sample.processes by PID, built after each pass */
+    int have_sample_index;
+    PidIndex in_view;           /* PIDs the UI shows, when a source is read only for those */
+    int have_in_view;
+    int schedstat_use;          /* column_source_use(COLSRC_SCHEDSTAT) for this pass */
+    int schedstat_cpu;          /* Take CPU% from schedstat (sub-second sampling) */
+    int io_use;                 /* column_source_use(COLSRC_IO) for this pass */
+    int fd_dropped;             /* PIDs whose stat could not be opened: EMFILE/ENFILE */
+    long page_kb;
+} ScanPass;
+
+static ScanPass g_scan_pass;
+
+static int reserve_scan_pass(ScanPass *sp, int need) {
+    if (need <= sp->capacity) return 0;
+    int new_cap = sp->capacity > 0 ? sp->capacity : 1024;
+    while (new_cap < need) new_cap *= 2;
+    int *pids = realloc(sp->pids, sizeof(int) * new_cap);
+    if (!pids) return -1;
+    sp->pids = pids;
+    int *slots = realloc(sp->cache_slot, sizeof(int) * new_cap);
+    if (!slots) return -1;
+    sp->cache_slot = slots;
+    unsigned char *ok = realloc(sp->ok, new_cap);
+    if (!ok) return -1;
+    sp->ok = ok;
+    sp->capacity = new_cap;
+    return 0;
+}
+
+/* Parse "<on-CPU ns> <run-queue wait ns> <timeslices>" */
+static int parse_schedstat(const char *buf, unsigned long long *run_ns, unsigned long long *wait_ns) {
+    const char *p = buf;
+    *run_ns = tok_ull(&p);
+    *wait_ns = tok_ull(&p);
+    return *run_ns > 0 || *wait_ns > 0;
+}
+
+/* /proc/<pid>/schedstat describes the thread group leader only, so the
+ * totals of a multi-threaded process are summed over task/<tid>/schedstat */
+static void sum_task_schedstat(int pid_fd, ProcessInfo *proc) {
+    int task_fd = openat(pid_fd, "task", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (task_fd < 0) return;
+    DIR *dir = fdopendir(task_fd);
+    if (!dir) {
+        close(task_fd);
+        return;
+    }
+    struct dirent *entry;
+    char path[32], buf[128];
+    while ((entry = readdir(dir)) != NULL) {
+        int tid = atoi(entry->d_name);
+        if (tid <= 0) continue;
+        snprintf(path, sizeof(path), "%d/schedstat", tid);
+        unsigned long long run_ns, wait_ns;
+        if (read_file_at(task_fd, path, buf, sizeof(buf)) > 0 && parse_schedstat(buf, &run_ns, &wait_ns)) {
+            proc->sched_run_ns += run_ns;
+            proc->sched_wait_ns += wait_ns;
+        }
+    }
+    closedir(dir);
+}
+
+/* Whether a source with column_source_use() value `use` is read for PID
+ * number `i`: for every process when it is the sort key, else for the rows
+ * in view */
+static int scan_wants(int use, int i) {
+    ScanPass *sp = &g_scan_pass;
+    return use == 2 || (use == 1 && sp->have_in_view && pid_index_find(&sp->in_view, sp->pids[i]) >= 0);
+}
+
+/* Read the schedstat totals of PID number `i` if this pass uses them: for
+ * the run-delay column (all processes when it is the sort key, else the rows
+ * in view) and for CPU% at sub-second sampling. A process too expensive to
+ * sum over its threads keeps its clock-tick CPU% instead. */
+static void scan_schedstat(int i, ProcessInfo *proc, int num_threads) {
+    ScanPass *sp = &g_scan_pass;
+    proc->sched_run_ns = 0;
+    proc->sched_wait_ns = 0;
+    
+    int column = scan_wants(sp->schedstat_use, i);
+    if (!column && !(sp->schedstat_cpu && num_threads <= 1)) return;
+    
+    char entry_name[16], buf[128];
+    snprintf(entry_name, sizeof(entry_name), "%d", sp->pids[i]);
+    int pid_fd = -1;
+    if (num_threads <= 1) {
+        int scratch_fd = -1;
+        int slot = sp->cache_slot[i];
+        int *fd = slot >= 0 ? &g_proc_cache.entries[slot].sched_fd : &scratch_fd;
+        if (cached_read(&g_proc_cache, fd, &pid_fd, entry_name, "schedstat", buf, sizeof(buf)) > 0) {
+            parse_schedstat(buf, &proc->sched_run_ns, &proc->sched_wait_ns);
+        }
+        proc_cache_close_fd(&g_proc_cache, &scratch_fd);
+    } else {
+        pid_fd = openat(g_proc_cache.proc_fd, entry_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (pid_fd >= 0) sum_task_schedstat(pid_fd, proc);
+    }
+    if (pid_fd >= 0) close(pid_fd);
+}
+
+/* Parse "rchar: N\nwchar: N\n..." into io[], which follows the file's order */
+static int parse_proc_io(const char *buf, unsigned long long *io) {
+    const char *p = buf;
+    for (int k = 0; k < NUM_IO; k++) {
+        p = strchr(p, ':');
+        if (!p) return 0;
+        p++;
+        io[k] = tok_ull(&p);
+    }
+    return 1;
+}
+
+/* Read /proc/<pid>/io of PID number `i` if an I/O column wants it. The
+ * counters already cover every thread of the process, including exited
+ * ones. Other users' processes are unreadable without root and keep
+ * have_io clear. */
+static void scan_io(int i, ProcessInfo *proc) {
+    ScanPass *sp = &g_scan_pass;
+    proc->have_io = 0;
+    if (!scan_wants(sp->io_use, i)) return;
+    
+    char entry_name[16], buf[256];
+    snprintf(entry_name, sizeof(entry_name), "%d", sp->pids[i]);
+    int pid_fd = -1, scratch_fd = -1;
+    int slot = sp->cache_slot[i];
+    int *fd = slot >= 0 ? &g_proc_cache.entries[slot].io_fd : &scratch_fd;
+    if (cached_read(&g_proc_cache, fd, &pid_fd, entry_name, "io", buf, sizeof(buf)) > 0) {
+        proc->have_io = (unsigned char)parse_proc_io(buf, proc->io);
+    }
+    proc_cache_close_fd(&g_proc_cache, &scratch_fd);
+    if (pid_fd >= 0) close(pid_fd);
+}
+
+/* Parse the stat record of PID number `i` of the pass into
+ * g_sample.processes[i] and mark the slot valid */
+static void scan_parse(int i, char *line) {
+    ScanPass *sp = &g_scan_pass;
+    
+    /* Reset only the fields that are not unconditionally written below */
+    ProcessInfo *proc = &g_sample.processes[i];
+    proc->starttime = 0;
+    proc->mem_rss = 0;
+    proc->cpu_percent = 0.0f;
+    proc->cpu_percent_lazy = 0.0f;
+    proc->blkio_ticks = 0;
+    proc->vsize = 0;
+    proc->minflt_rate = -1.0f;
+    proc->majflt_rate = -1.0f;
+    for (int d = 0; d < NUM_DELAYS; d++) proc->delay[d] = -1.0f;
+    proc->run_delay = -1.0f;
+    for (int k = 0; k < NUM_IO; k++) proc->io_rate[k] = -1.0f;
+    
+    char *p = strchr(line, '(');
+    if (!p) return;
+    
+    const char *tp = line;
+    proc->pid = (int)tok_ll(&tp);
+    
+    char *end = strrchr(p, ')');
+    if (!end) return;
+    
+    int comm_len = end - p - 1;
+    if (comm_len < 0) comm_len = 0;
+    if (comm_len >= (int)sizeof(proc->name)) comm_len = sizeof(proc->name) - 1;
+    memcpy(proc->name, p + 1, comm_len);
+    proc->name[comm_len] = '\0';
+    
+    /* Fields after comm: state(3), ppid(4), pgrp..flags(5-9), minflt(10),
+     * cminflt(11), majflt(12), cmajflt(13), utime(14), stime(15),
+     * cutime..priority(16-18), nice(19), num_threads(20), itrealvalue(21),
+     * starttime(22), vsize(23), rss(24), rsslim..exit_signal(25-38),
+     * processor(39), rt_priority..policy(40-41), delayacct_blkio_ticks(42) */
+    tp = tok_skip_ws(end + 1);
+    proc->state = *tp ? *tp++ : '?';
+    proc->ppid = (int)tok_ll(&tp);
+    tp = tok_skip_fields(tp, 5);
+    proc->minflt = tok_ull(&tp);
+    tp = tok_skip_fields(tp, 1);
+    proc->majflt = tok_ull(&tp);
+    tp = tok_skip_fields(tp, 1);
+    unsigned long utime = tok_ull(&tp);
+    unsigned long stime = tok_ull(&tp);
+    tp = tok_skip_fields(tp, 3);
+    proc->nice = (signed char)tok_ll(&tp);
+    proc->num_threads = (int)tok_ll(&tp);
+    tp = tok_skip_fields(tp, 1);
+    proc->starttime = tok_ull(&tp);
+    proc->vsize = tok_ull(&tp);
+    /* rss is the same counter status reports as VmRSS */
+    proc->mem_rss = (long)tok_ll(&tp) * sp->page_kb;
+    tp = tok_skip_fields(tp, 14);
+    proc->processor = (short)tok_ll(&tp);
+    tp = tok_skip_fields(tp, 2);
+    proc->blkio_ticks = tok_ull(&tp);
+    
+    /* Phase one reads only stat; cmdline and user are fetched by the UI for
+     * the rows it shows (fetch_visible_details) */
+    proc->mem_percent = g_sample.total_mem > 0 ? 
+        (proc->mem_rss * 100.0f) / g_sample.total_mem : 0;
+    
+    /* Store current CPU times */
+    long current_utime = utime;
+    long current_stime = stime;
+    
+    scan_schedstat(i, proc, proc->num_threads);
+    scan_io(i, proc);
+    
+    /* Look up the previous sample; a different starttime means the PID was reused */
+    proc->cpu_percent = 0.0f;
+    int j = sp->have_index ? pid_index_find(&sp->prev_index, proc->pid) : -1;
+    if (j >= 0 && sp->prev_procs[j].starttime == proc->starttime) {
+        /* Found existing process - calculate CPU% from delta */
+        long delta_utime = current_utime - sp->prev_procs[j].prev_utime;
+        long delta_stime = current_stime - sp->prev_procs[j].prev_stime;
+        long delta_total = delta_utime + delta_stime;
+        
+        /* CPU% = (delta_ticks / clock_ticks_per_second) / elapsed_seconds * 100 / num_cores */
+        float cpu_raw = 0.0f;
+        if (g_sample.num_cores > 0 && g_elapsed_seconds > 0) {
+            cpu_raw = (delta_total * 100.0f) / (g_clk_tck * g_elapsed_seconds * g_sample.num_cores);
+        }
+        
+        /* schedstat has the same on-CPU time in ns. Its sums lose the time of
+         * threads that exited, so a counter that went backwards is skipped. */
+        const ProcessInfo *prev = &sp->prev_procs[j];
+        if (proc->sched_run_ns > 0 && prev->sched_run_ns > 0 && g_elapsed_seconds > 0 &&
+            proc->sched_run_ns >= prev->sched_run_ns && proc->sched_wait_ns >= prev->sched_wait_ns) {
+            if (sp->schedstat_cpu && g_sample.num_cores > 0) {
+                cpu_raw = (proc->sched_run_ns - prev->sched_run_ns) * 100.0f /
+                          (1e9f * g_elapsed_seconds * g_sample.num_cores);
+            }
+            proc->run_delay = (proc->sched_wait_ns - prev->sched_wait_ns) / 1e6f / g_elapsed_seconds;
+        }
+        proc->cpu_percent = cpu_raw;
+        
+        /* Lazy mode: exponential moving average (smoothing factor 0.3) */
+        proc->cpu_percent_lazy = sp->prev_procs[j].cpu_percent_lazy;
+        if (proc->cpu_percent_lazy > 0 || cpu_raw > 0) {
+            proc->cpu_percent_lazy = proc->cpu_percent_lazy * 0.7f + cpu_raw * 0.3f;
+        } else {
+            proc->cpu_percent_lazy = cpu_raw;
+        }
+        
+        /* Block I/O delay from stat; taskstats overrides it with ns precision */
+        if (g_elapsed_seconds > 0 && proc->blkio_ticks >= prev->blkio_ticks) {
+            proc->delay[DELAY_BLKIO] = (proc->blkio_ticks - prev->blkio_ticks) * 1000.0f /
+                                       (g_clk_tck * g_elapsed_seconds);
+        }
+        if (g_elapsed_seconds > 0 && proc->minflt >= prev->minflt && proc->majflt >= prev->majflt) {
+            proc->minflt_rate = (proc->minflt - prev->minflt) / g_elapsed_seconds;
+            proc->majflt_rate = (proc->majflt - prev->majflt) / g_elapsed_seconds;
+        }
+        if (g_elapsed_seconds > 0 && proc->have_io && prev->have_io) {
+            for (int k = 0; k < NUM_IO; k++) {
+                if (proc->io[k] >= prev->io[k]) {
+                    proc->io_rate[k] = (proc->io[k] - prev->io[k]) / g_elapsed_seconds;
+                }
+            }
+        }
+    }
+    
+    /* Store current values for next time */
+    proc->prev_utime = current_utime;
+    proc->prev_stime = current_stime;
+    proc->ident_seq = sp->cache_slot[i] >= 0 ? g_proc_cache.entries[sp->cache_slot[i]].ident_seq : 0;
+    sp->ok[i] = 1;
+}
+
+/* Cached (slot) fd of PID number `i`, or NULL if it has no cache entry */
+static inline int *scan_stat_fd(int i) {
+    int slot = g_scan_pass.cache_slot[i];
+    return slot >= 0 ? &g_proc_cache.entries[slot].stat_fd : NULL;
+}
+
+/* Read and parse /proc/<pid>/stat for PID number `i` with plain syscalls.
+ * Runs on any scan worker; `buf` is the worker's. */
+static void scan_one(int i, char *buf) {
+    g_scan_pass.ok[i] = 0;
+    
+    char entry_name[16];
+    snprintf(entry_name, sizeof(entry_name), "%d", g_scan_pass.pids[i]);
+    
+    /* Files not already cached are opened through one per-PID dirfd, so
+     * they describe the same process even if the PID is reused mid-scan */
+    int pid_fd = -1;
+    int scratch_stat_fd = -1;
+    int *stat_fd = scan_stat_fd(i);
+    if (!stat_fd) stat_fd = &scratch_stat_fd;
+    
+    ssize_t got = cached_read(&g_proc_cache, stat_fd, &pid_fd, entry_name, "stat", buf, SCAN_BUF_SIZE);
+    if (got < 0 && (errno == EMFILE || errno == ENFILE)) {
+        __atomic_add_fetch(&g_scan_pass.fd_dropped, 1, __ATOMIC_RELAXED);
+    }
+    if (pid_fd >= 0) close(pid_fd);
+    proc_cache_close_fd(&g_proc_cache, &scratch_stat_fd);
+    if (got > 0) scan_parse(i, buf);
+}
+
+#ifdef HAVE_IO_URING
+/* io_uring backend for the stat pass, used when the kernel has it (5.19+ for
+ * sparse registered files). A worker submits a whole chunk of PIDs with one
+ * io_uring_enter(): a read for each cached fd, an openat for each PID whose
+ * fd will be kept, and an openat -> read -> close chain on a registered
+ * (direct) file slot for the rest, so those never enter the fd table at all.
+ * A second submission reads the freshly opened fds. Anything that fails
+ * falls back to scan_one(), which also covers exited and reused PIDs.
+ * procfs files cannot be read without blocking, so the kernel hands these
+ * requests to its io-wq threads; that is why this is off by default. */
+#define URING_BATCH 64
+#define URING_DEPTH 256         /* Worst case three SQEs per PID */
+#define URING_BUF_SIZE 1024     /* A stat record is well under this */
+#define URING_SUBMIT_RETRIES 8  /* io_uring_enter() EAGAIN/EBUSY retries before giving up */
+
+enum { URING_READ, URING_OPEN_KEEP, URING_CHAIN_OPEN, URING_CHAIN_READ, URING_CHAIN_CLOSE };
+
+typedef struct {
+    int fd;
+    unsigned int *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    unsigned int sq_entries;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *ring_map;
+    size_t ring_map_len;
+    size_t sqes_map_len;
+    unsigned int queued;        /* SQEs written since the last submit */
+    char (*bufs)[URING_BUF_SIZE];
+    char (*paths)[24];
+    int state[URING_BATCH];     /* Per PID of the batch: 1 = read done, -1 = fall back */
+    int broken;                 /* Completions could not be waited for; never reuse the buffers */
+} Uring;
+
+static void uring_free(Uring *r) {
+    if (r->sqes) munmap(r->sqes, r->sqes_map_len);
+    if (r->ring_map) munmap(r->ring_map, r->ring_map_len);
+    if (r->fd >= 0) close(r->fd);
+    free(r->bufs);
+    free(r->paths);
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+static int uring_init(Uring *r) {
+    memset(r, 0, sizeof(*r));
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    r->fd = (int)syscall(__NR_io_uring_setup, URING_DEPTH, &params);
+    if (r->fd < 0) return -1;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP)) goto fail;
+    
+    size_t sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    size_t cq_len = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    r->ring_map_len = sq_len > cq_len ? sq_len : cq_len;
+    r->ring_map = mmap(NULL, r->ring_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       r->fd, IORING_OFF_SQ_RING);
+    if (r->ring_map == MAP_FAILED) { r->ring_map = NULL; goto fail; }
+    r->sqes_map_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) { r->sqes = NULL; goto fail; }
+    
+    char *ring = r->ring_map;
+    r->sq_head = (unsigned int *)(ring + params.sq_off.head);
+    r->sq_tail = (unsigned int *)(ring + params.sq_off.tail);
+    r->sq_mask = (unsigned int *)(ring + params.sq_off.ring_mask);
+    r->sq_array = (unsigned int *)(ring + params.sq_off.array);
+    r->cq_head = (unsigned int *)(ring + params.cq_off.head);
+    r->cq_tail = (unsigned int *)(ring + params.cq_off.tail);
+    r->cq_mask = (unsigned int *)(ring + params.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(ring + params.cq_off.cqes);
+    r->sq_entries = params.sq_entries;
+    
+    /* One direct file slot per PID of a batch for the open/read/close chains */
+    struct io_uring_rsrc_register reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.nr = URING_BATCH;
+    reg.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_FILES2, &reg, sizeof(reg)) < 0) goto fail;
+    
+    r->bufs = malloc(sizeof(*r->bufs) * URING_BATCH);
+    r->paths = malloc(sizeof(*r->paths) * URING_BATCH);
+    if (!r->bufs || !r->paths) goto fail;
+    return 0;
+    
+fail:
+    uring_free(r);
+    return -1;
+}
+
+static struct io_uring_sqe *uring_sqe(Uring *r, int op, int fd, unsigned long long user_data) {
+    unsigned int tail = *r->sq_tail + r->queued;
+    unsigned int idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (unsigned char)op;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+    r->sq_array[idx] = idx;
+    r->queued++;
+    return sqe;
+}
+
+/* Take back the SQEs the kernel has not consumed yet, releasing the fd
+ * budget slots their opens claimed. Returns how many were withdrawn. */
+static unsigned int uring_withdraw(Uring *r) {
+    unsigned int head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+    unsigned int tail = *r->sq_tail;
+    for (unsigned int h = head; h != tail; h++) {
+        const struct io_uring_sqe *sqe = &r->sqes[r->sq_array[h & *r->sq_mask]];
+        if ((int)(sqe->user_data & 0xff) == URING_OPEN_KEEP) {
+            __atomic_sub_fetch(&g_proc_cache.open_fds, 1, __ATOMIC_RELAXED);
+        }
+    }
+    __atomic_store_n(r->sq_tail, head, __ATOMIC_RELEASE);
+    return tail - head;
+}
+
+/* Submit everything queued and wait for all of its completions. A submit
+ * the kernel refuses for now (EAGAIN, EBUSY) is retried; if it keeps being
+ * refused the rest is withdrawn and -1 returned, but only once everything
+ * that did go in has completed. So no completion lands in a later batch,
+ * every fd an open returned is recorded, and the buffers are free again. */
+static int uring_submit_and_reap(Uring *r, int batch_first) {
+    unsigned int expected = r->queued;
+    __atomic_store_n(r->sq_tail, *r->sq_tail + r->queued, __ATOMIC_RELEASE);
+    r->queued = 0;
+    
+    unsigned int reaped = 0;
+    int retries = 0, failed = 0;
+    while (reaped < expected) {
+        unsigned int pending = *r->sq_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+        long ret = syscall(__NR_io_uring_enter, r->fd, pending,
+                           expected - reaped, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0 && errno != EINTR) {
+            if ((errno == EAGAIN || errno == EBUSY) && retries++ < URING_SUBMIT_RETRIES) {
+                sched_yield();
+            } else if (pending > 0) {
+                expected -= uring_withdraw(r);
+                failed = 1;
+            } else {
+                /* Cannot wait for what is in flight: the kernel may still
+                 * write the buffers, so this ring is done for */
+                r->broken = 1;
+                return -1;
+            }
+        }
+        
+        unsigned int head = *r->cq_head;
+        unsigned int tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++, reaped++) {
+            struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            int k = (int)(cqe->user_data >> 8);
+            int kind = (int)(cqe->user_data & 0xff);
+            int i = batch_first + k;
+            int res = cqe->res;
+            
+            if (kind == URING_READ || kind == URING_CHAIN_READ) {
+                if (res > 0) {
+                    r->bufs[k][res] = '\0';
+                    r->state[k] = 1;
+                } else {
+                    r->state[k] = -1;
+                }
+            } else if (kind == URING_OPEN_KEEP) {
+                int *fd = scan_stat_fd(i);
+                if (res >= 0) {
+                    *fd = res;
+                } else {
+                    __atomic_sub_fetch(&g_proc_cache.open_fds, 1, __ATOMIC_RELAXED);
+                    r->state[k] = -1;
+                }
+            } else if (kind == URING_CHAIN_OPEN && res < 0) {
+                r->state[k] = -1;
+            }
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return failed ? -1 : 0;
+}
+
+/* Scan PIDs [first, last) of the pass, at most URING_BATCH of them */
+static void scan_batch_uring(Uring *r, int first, int last, char *buf) {
+    int n = last - first;
+    int pc_fd = g_proc_cache.proc_fd;
+    int reopen = 0;
+    
+    if (r->broken) {
+        for (int i = first; i < last; i++) scan_one(i, buf);
+        return;
+    }
+    
+    for (int k = 0; k < n; k++) {
+        int i = first + k;
+        g_scan_pass.ok[i] = 0;
+        r->state[k] = 0;
+        unsigned long long tag = (unsigned long long)k << 8;
+        int *fd = scan_stat_fd(i);
+        
+        if (fd && *fd >= 0) {
+            struct io_uring_sqe *sqe = uring_sqe(r, IORING_OP_READ, *fd, tag | URING_READ);
+            sqe->addr = (unsigned long)r->bufs[k];
+            sqe->len = URING_BUF_SIZE - 1;
+            continue;
+        }
+        
+        snprintf(r->paths[k], sizeof(r->paths[k]), "%d/stat", g_scan_pass.pids[i]);
+        if (fd && __atomic_add_fetch(&g_proc_cache.open_fds, 1, __ATOMIC_RELAXED) <= g_proc_cache.budget) {
+            struct io_uring_sqe *sqe = uring_sqe(r, IORING_OP_OPENAT, pc_fd, tag | URING_OPEN_KEEP);
+            sqe->addr = (unsigned long)r->paths[k];
+            sqe->open_flags = O_RDONLY | O_CLOEXEC;
+            reopen = 1;
+            continue;
+        }
+        if (fd) __atomic_sub_fetch(&g_proc_cache.open_fds, 1, __ATOMIC_RELAXED);
+        
+        struct io_uring_sqe *sqe = uring_sqe(r, IORING_OP_OPENAT, pc_fd, tag | URING_CHAIN_OPEN);
+        sqe->addr = (unsigned long)r->paths[k];
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        sqe->file_index = k + 1;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe = uring_sqe(r, IORING_OP_READ, k, tag | URING_CHAIN_READ);
+        sqe->addr = (unsigned long)r->bufs[k];
+        sqe->len = URING_BUF_SIZE - 1;
+        sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+        sqe = uring_sqe(r, IORING_OP_CLOSE, 0, tag | URING_CHAIN_CLOSE);
+        sqe->file_index = k + 1;
+    }
+    
+    int failed = uring_submit_and_reap(r, first) != 0;
+    
+    /* Second round: read the fds opened to be kept */
+    if (!failed && reopen) {
+        for (int k = 0; k < n; k++) {
+            int *fd = scan_stat_fd(first + k);
+            if (r->state[k] != 0 || !fd || *fd < 0) continue;
+            struct io_uring_sqe *sqe = uring_sqe(r, IORING_OP_READ, *fd, ((unsigned long long)k << 8) | URING_READ);
+            sqe->addr = (unsigned long)r->bufs[k];
+            sqe->len = URING_BUF_SIZE - 1;
+        }
+        failed = uring_submit_and_reap(r, first) != 0;
+    }
+    
+    /* Reads that completed are good even if the batch failed */
+    for (int k = 0; k < n; k++) {
+        int i = first + k;
+        if (!r->broken && r->state[k] == 1) {
+            scan_parse(i, r->bufs[k]);
+            continue;
+        }
+        /* A cached fd that fails belongs to an exited process; scan_one()
+         * reopens by PID in case it was reused */
+        int *fd = scan_stat_fd(i);
+        if (fd && *fd >= 0 && r->state[k] == -1) proc_cache_close_fd(&g_proc_cache, fd);
+        scan_one(i, buf);
+    }
+}
+#endif
+
+/* Scan worker pool. The PID list is cut into one contiguous range per
+ * thread; a thread claims chunks from its own range with an atomic
+ * fetch-add on the range cursor and, once that is empty, steals chunks from
+ * the other ranges the same way. Per-PID read cost varies a lot (fd cached
+ * or not, kernel threads vs. huge processes), so static shards alone would
+ * leave threads idle. */
+#define MAX_SCAN_THREADS 64
+#define SCAN_CHUNK 16
+#define SCAN_MIN_PIDS_PER_THREAD 256
+
+typedef struct {
+    int next;                   /* Claimed with __atomic_fetch_add */
+    int end;
+    char pad[64 - 2 * sizeof(int)];     /* One cache line per range */
+} ScanRange;
+
+typedef struct {
+    pthread_t thread;
+    char buf[SCAN_BUF_SIZE];
+#ifdef HAVE_IO_URING
+    Uring ring;
+#endif
+} ScanWorker;
+
+static struct {
+    ScanRange ranges[MAX_SCAN_THREADS];
+    ScanWorker *workers;        /* workers[0] is the collector thread */
+    int threads;                /* Including the collector; 0 until started */
+    int chunk;                  /* PIDs claimed per fetch-add */
+    int use_uring;
+    int active;                 /* Ranges in the current round */
+    unsigned int round;
+    int pending;                /* Workers still busy in the current round */
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+} g_scan_pool = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .start = PTHREAD_COND_INITIALIZER,
+    .done = PTHREAD_COND_INITIALIZER,
+};
+
+static void scan_drain(int self, int active) {
+    ScanWorker *w = &g_scan_pool.workers[self];
+    int chunk = g_scan_pool.chunk;
+    for (int k = 0; k < active; k++) {
+        ScanRange *r = &g_scan_pool.ranges[(self + k) % active];
+        for (;;) {
+            int first = __atomic_fetch_add(&r->next, chunk, __ATOMIC_RELAXED);
+            if (first >= r->end) break;
+            int last = first + chunk < r->end ? first + chunk : r->end;
+#ifdef HAVE_IO_URING
+            if (g_scan_pool.use_uring) {
+                scan_batch_uring(&w->ring, first, last, w->buf);
+                continue;
+            }
+#endif
+            for (int i = first; i < last; i++) scan_one(i, w->buf);
+        }
+    }
+}
+
+static void *scan_worker_main(void *arg) {
+    int self = (int)(intptr_t)arg;
+    unsigned int seen = 0;
+    for (;;) {
+        pthread_mutex_lock(&g_scan_pool.lock);
+        while (g_scan_pool.round == seen) pthread_cond_wait(&g_scan_pool.start, &g_scan_pool.lock);
+        seen = g_scan_pool.round;
+        int active = g_scan_pool.active;
+        pthread_mutex_unlock(&g_scan_pool.lock);
+        
+        if (self < active) scan_drain(self, active);
+        
+        pthread_mutex_lock(&g_scan_pool.lock);
+        if (--g_scan_pool.pending == 0) pthread_cond_signal(&g_scan_pool.done);
+        pthread_mutex_unlock(&g_scan_pool.lock);
+    }
+    return NULL;
+}
+
+/* Scan workers to run: -j, else scan_threads=, else one per CPU up to 8 */
+static int scan_threads_wanted(void) {
+    int want = g_scan_threads_cli > 0 ? g_scan_threads_cli : g_scan_threads;
+    if (want <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        want = cpus > 8 ? 8 : (cpus > 0 ? (int)cpus : 1);
+    }
+    return want > MAX_SCAN_THREADS ? MAX_SCAN_THREADS : want;
+}
+
+/* fds that are open next to the cached ones at worst: a fixed base plus
+ * what every scan worker and reader thread holds while it reads */
+static long fd_reserve(void) {
+    return FD_CACHE_RESERVE + (long)scan_threads_wanted() * FD_RESERVE_PER_SCAN_THREAD +
+           READER_MAX * FD_RESERVE_PER_READER;
+}
+
+/* Start the workers on first use; a thread that fails to start just shrinks
+ * the pool */
+static void scan_pool_start(void) {
+    int want = scan_threads_wanted();
+    
+    g_scan_pool.workers = calloc(want, sizeof(ScanWorker));
+    if (!g_scan_pool.workers) return;
+    g_scan_pool.threads = 1;
+    g_scan_pool.chunk = SCAN_CHUNK;
+    
+#ifdef HAVE_IO_URING
+    /* Every worker gets its own ring; if any cannot, nobody uses io_uring */
+    if (g_scan_io_uring) {
+        int rings = 0;
+        while (rings < want && uring_init(&g_scan_pool.workers[rings].ring) == 0) rings++;
+        if (rings == want) {
+            g_scan_pool.use_uring = 1;
+            g_scan_pool.chunk = URING_BATCH;
+        } else {
+            while (rings > 0) uring_free(&g_scan_pool.workers[--rings].ring);
+        }
+    }
+#endif
+    
+    for (int t = 1; t < want; t++) {
+        if (pthread_create(&g_scan_pool.workers[t].thread, NULL, scan_worker_main, (void *)(intptr_t)t) != 0) break;
+        g_scan_pool.threads++;
+    }
+}
+
+/* Run scan_one() for PIDs [0, n) of the pass, spread over the pool */
+static void scan_parallel(int n) {
+    if (g_scan_pool.threads == 0) scan_pool_start();
+    if (g_scan_pool.threads == 0) {
+        for (int i = 0; i < n; i++) scan_one(i, g_scanner.buf);
+        return;
+    }
+    
+    int active = 1 + n / SCAN_MIN_PIDS_PER_THREAD;
+    if (active > g_scan_pool.threads) active = g_scan_pool.threads;
+    for (int t = 0; t < active; t++) {
+        g_scan_pool.ranges[t].next = (int)((long)n * t / active);
+        g_scan_pool.ranges[t].end = (int)((long)n * (t + 1) / active);
+    }
+    if (active == 1) {
+        scan_drain(0, 1);
+        return;
+    }
+    
+    pthread_mutex_lock(&g_scan_pool.lock);
+    g_scan_pool.active = active;
+    g_scan_pool.pending = g_scan_pool.threads - 1;
+    g_scan_pool.round++;
+    pthread_cond_broadcast(&g_scan_pool.start);
+    pthread_mutex_unlock(&g_scan_pool.lock);
+    
+    scan_drain(0, active);
+    
+    pthread_mutex_lock(&g_scan_pool.lock);
+    while (g_scan_pool.pending > 0) pthread_cond_wait(&g_scan_pool.done, &g_scan_pool.lock);
+    pthread_mutex_unlock(&g_scan_pool.lock);
+}
+
+/* Event-driven PID tracking through the netlink proc connector, available to
+ * root or CAP_NET_ADMIN. Forks are logged so that a pass can take the last
+ * sample's PIDs plus the new ones instead of listing /proc, which is then
+ * listed only every PROC_RESCAN_MS or after events were lost. Exits need no
+ * bookkeeping: a reaped PID fails its stat read and drops out, while a zombie
+ * stays listed just like in /proc. Exec and
+ * uid events bump the PID's ident_seq so the UI re-reads its cmdline and user,
+ * and exits go to the recently exited list, which also catches processes that
+ * lived and died between two passes. All of it runs on the collector thread. */
+#define PROC_EVENTS_RCVBUF (4 << 20)
+#define PROC_EVENTS_LOG_MAX 65536   /* Past this many forks the log is dropped for a rescan */
+
+static struct {
+    int fd;
+    int tried;
+    int lost;                   /* Events were dropped, the log cannot be trusted */
+    int ack;                    /* 1 + the error of the subscription ack, 0 until it arrives */
+    int64_t last_rescan_ms;
+    int *forked;                /* PIDs forked since the last pass */
+    int forked_count;
+    int forked_capacity;
+    PidIndex forked_index;
+} g_proc_events = { .fd = -1 };
+
+static void proc_events_log_fork(int pid) {
+    if (g_proc_events.lost) return;
+    if (g_proc_events.forked_count == g_proc_events.forked_capacity) {
+        int new_cap = g_proc_events.forked_capacity > 0 ? g_proc_events.forked_capacity * 2 : 1024;
+        int *grown = new_cap <= PROC_EVENTS_LOG_MAX ?
+            realloc(g_proc_events.forked, sizeof(int) * new_cap) : NULL;
+        if (!grown) {
+            g_proc_events.lost = 1;
+            g_proc_events.forked_count = 0;
+            return;
+        }
+        g_proc_events.forked = grown;
+        g_proc_events.forked_capacity = new_cap;
+    }
+    g_proc_events.forked[g_proc_events.forked_count++] = pid;
+}
+
+/* Exec or uid change: the cached cmdline and user of `pid` are stale */
+static void proc_events_touch(int pid) {
+    int i = pid_index_find(&g_proc_cache.index, pid);
+    if (i >= 0 && i < g_proc_cache.count) g_proc_cache.entries[i].ident_seq++;
+}
+
+static void proc_events_record_exit(int pid, int ppid, int status) {
+    ExitedProc *x = &g_sample.exited[g_sample.exited_head];
+    g_sample.exited_head = (g_sample.exited_head + 1) % EXITED_MAX;
+    if (g_sample.exited_count < EXITED_MAX) g_sample.exited_count++;
+    x->pid = pid;
+    x->ppid = ppid;
+    x->status = status;
+    x->exit_ms = get_time_ms();
+    x->lifetime_ms = -1;
+    x->name[0] = '\0';
+    
+    /* Until its parent reaps it the process is a zombie whose stat is still
+     * readable; past that, fall back to what the last pass saw */
+    unsigned long long starttime = 0;
+    char path[32], buf[512];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    ssize_t n = fd >= 0 ? read(fd, buf, sizeof(buf) - 1) : -1;
+    if (fd >= 0) close(fd);
+    char *open_paren = NULL, *close_paren = NULL;
+    if (n > 0) {
+        buf[n] = '\0';
+        open_paren = strchr(buf, '(');
+        close_paren = strrchr(buf, ')');
+    }
+    if (open_paren && close_paren && close_paren > open_paren) {
+        size_t len = close_paren - open_paren - 1;
+        if (len >= sizeof(x->name)) len = sizeof(x->name) - 1;
+        memcpy(x->name, open_paren + 1, len);
+        x->name[len] = '\0';
+        /* state(3), then fields 4-21, then starttime(22) */
+        const char *tp = tok_skip_fields(tok_skip_ws(close_paren + 1), 19);
+        starttime = tok_ull(&tp);
+    } else {
+        int j = g_scan_pass.have_sample_index ? pid_index_find(&g_scan_pass.sample_index, pid) : -1;
+        if (j >= 0 && j < g_sample.process_count) {
+            const char *name = g_sample.processes[j].name;
+            size_t len = strnlen(name, sizeof(x->name) - 1);
+            memcpy(x->name, name, len);
+            x->name[len] = '\0';
+            starttime = g_sample.processes[j].starttime;
+        }
+    }
+    
+    struct timespec ts;
+    if (starttime > 0 && g_clk_tck > 0 && clock_gettime(CLOCK_BOOTTIME, &ts) == 0) {
+        int64_t up_ms = (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+        x->lifetime_ms = up_ms - (int64_t)(starttime * 1000 / g_clk_tck);
+        if (x->lifetime_ms < 0) x->lifetime_ms = 0;
+    }
+}
+
+#ifdef HAVE_PROC_EVENTS
+static void proc_event_handle(const struct proc_event *ev) {
+    switch (ev->what) {
+    case PROC_EVENT_NONE:
+        g_proc_events.ack = 1 + (int)ev->event_data.ack.err;
+        break;
+    case PROC_EVENT_FORK:
+        /* Threads are clones too; only new thread groups are processes */
+        if (ev->event_data.fork.child_pid == ev->event_data.fork.child_tgid) {
+            proc_events_log_fork(ev->event_data.fork.child_tgid);
+        }
+        break;
+    case PROC_EVENT_EXEC:
+        proc_events_touch(ev->event_data.exec.process_tgid);
+        break;
+    case PROC_EVENT_UID:
+        proc_events_touch(ev->event_data.id.process_tgid);
+        break;
+    case PROC_EVENT_EXIT:
+        if (ev->event_data.exit.process_pid == ev->event_data.exit.process_tgid) {
+            proc_events_record_exit(ev->event_data.exit.process_tgid,
+                                    ev->event_data.exit.parent_tgid,
+                                    (int)ev->event_data.exit.exit_code);
+        }
+        break;
+    default:
+        break;
+    }
+}
+#endif
+
+/* Handle every event queued on the socket; never blocks */
+static void proc_events_drain(void) {
+#ifdef HAVE_PROC_EVENTS
+    if (g_proc_events.fd < 0) return;
+    static union {
+        struct nlmsghdr hdr;
+        char raw[16384];
+    } msg;
+    for (;;) {
+        ssize_t got = recv(g_proc_events.fd, &msg, sizeof(msg), 0);
+        if (got < 0) {
+            if (errno == EINTR) continue;
+            /* ENOBUFS: the socket overran while we were busy */
+            if (errno == ENOBUFS) {
+                g_proc_events.lost = 1;
+                g_proc_events.forked_count = 0;
+                continue;
+            }
+            return;
+        }
+        int len = (int)got;
+        for (struct nlmsghdr *nl = &msg.hdr; NLMSG_OK(nl, len); nl = NLMSG_NEXT(nl, len)) {
+            if (nl->nlmsg_type != NLMSG_DONE) continue;
+            struct cn_msg *cn = NLMSG_DATA(nl);
+            if (cn->id.idx != CN_IDX_PROC || cn->id.val != CN_VAL_PROC) continue;
+            /* The payload is only 4-byte aligned and proc_event has 64-bit
+             * fields, so it is copied out before any field is read */
+            struct proc_event ev;
+            memset(&ev, 0, sizeof(ev));
+            size_t n = cn->len < sizeof(ev) ? cn->len : sizeof(ev);
+            memcpy(&ev, cn->data, n);
+            proc_event_handle(&ev);
+        }
+    }
+#endif
+}
+
+/* Subscribe to proc events. Without the privilege the bind or the
+ * subscription fails and PIDs keep coming from listing /proc. */
+static void proc_events_open(void) {
+    g_proc_events.tried = 1;
+#ifdef HAVE_PROC_EVENTS
+    if (!g_proc_events_enabled) return;
+    int fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (fd < 0) return;
+    
+    /* Room for the bursts that queue up while a scan is running */
+    int rcvbuf = PROC_EVENTS_RCVBUF;
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf)) != 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    }
+    
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = CN_IDX_PROC;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return;
+    }
+    
+    enum proc_cn_mcast_op op = PROC_CN_MCAST_LISTEN;
+    union {
+        struct nlmsghdr hdr;
+        char raw[NLMSG_SPACE(sizeof(struct cn_msg) + sizeof(op))];
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.hdr.nlmsg_len = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(op));
+    req.hdr.nlmsg_type = NLMSG_DONE;
+    req.hdr.nlmsg_pid = getpid();
+    struct cn_msg *cn = NLMSG_DATA(&req.hdr);
+    cn->id.idx = CN_IDX_PROC;
+    cn->id.val = CN_VAL_PROC;
+    cn->len = sizeof(op);
+    memcpy(cn->data, &op, sizeof(op));
+    if (send(fd, &req, req.hdr.nlmsg_len, 0) < 0) {
+        close(fd);
+        return;
+    }
+    
+    /* The kernel acks the subscription, with EPERM if we lack the privilege */
+    g_proc_events.fd = fd;
+    g_proc_events.ack = 0;
+    int64_t deadline = get_time_ms() + 250;
+    while (g_proc_events.ack == 0) {
+        int64_t left = deadline - get_time_ms();
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (left <= 0 || poll(&pfd, 1, (int)left) <= 0) break;
+        proc_events_drain();
+    }
+    if (g_proc_events.ack != 1) {
+        close(fd);
+        g_proc_events.fd = -1;
+        return;
+    }
+    g_proc_events.lost = 1;     /* No baseline until the first listing */
+    g_sample.proc_events = 1;
+#endif
+}
+
+/* Build the PID list of a pass from the last sample's PIDs and the event log.
+ * Returns the PID count, or -1 if /proc has to be listed instead. */
+static int proc_events_list(ScanPass *sp, int64_t now) {
+    if (g_proc_events.fd < 0 || g_proc_events.lost || !sp->have_index ||
+        now - g_proc_events.last_rescan_ms >= PROC_RESCAN_MS) return -1;
+    
+    /* A forked PID can already be listed if its predecessor exited and it was
+     * reused, or be logged twice */
+    PidIndex *fi = &g_proc_events.forked_index;
+    if (pid_index_reset(fi, g_proc_events.forked_count) != 0) return -1;
+    
+    int n = 0;
+    if (reserve_scan_pass(sp, g_prev_proc_count + g_proc_events.forked_count) != 0) return -1;
+    for (int j = 0; j < g_prev_proc_count; j++) {
+        sp->pids[n++] = g_prev_procs[j].pid;
+    }
+    for (int k = 0; k < g_proc_events.forked_count; k++) {
+        int pid = g_proc_events.forked[k];
+        if (pid_index_find(&sp->prev_index, pid) >= 0 || pid_index_find(fi, pid) >= 0) continue;
+        pid_index_insert(fi, pid, n);
+        sp->pids[n++] = pid;
+    }
+    g_proc_events.forked_count = 0;
+    return n;
+}
+
+/* /proc was just listed: the log up to here is covered by that listing */
+static void proc_events_rescanned(int64_t now) {
+    g_proc_events.forked_count = 0;
+    g_proc_events.lost = 0;
+    g_proc_events.last_rescan_ms = now;
+}
+
+/* Delay accounting through the taskstats generic netlink family (root only).
+ * Queries go out in batches: one send() carries up to TASKSTATS_BATCH
+ * requests, the kernel answers them all before send() returns, and the
+ * replies are reaped without blocking. Only the rows the UI has in view are
+ * queried, unless a delay is the sort key. Queries are by TGID, so the
+ * kernel totals the delays of every thread of the process, including those
+ * that already exited, not just the leader's. The kernel only accounts delays
+ * with delayacct on (the kernel.task_delayacct sysctl). */
+#define TASKSTATS_BATCH 64
+#define TASKSTATS_REQ_SIZE NLMSG_SPACE(GENL_HDRLEN + NLA_HDRLEN + sizeof(uint32_t))
+
+static struct {
+    int fd;
+    int family;
+    int tried;
+    int *rows;                  /* Processes of the sample to query */
+    int capacity;
+} g_taskstats = { .fd = -1 };
+
+#ifdef HAVE_TASKSTATS
+/* Append one generic netlink request with a single attribute to `buf` */
+static size_t genl_put_request(char *buf, int type, int cmd, unsigned int seq,
+                               int attr, const void *data, size_t len) {
+    struct nlmsghdr *nl = (struct nlmsghdr *)buf;
+    memset(buf, 0, NLMSG_SPACE(GENL_HDRLEN + NLA_HDRLEN + len));
+    nl->nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN + NLA_HDRLEN + len);
+    nl->nlmsg_type = type;
+    nl->nlmsg_flags = NLM_F_REQUEST;
+    nl->nlmsg_seq = seq;
+    struct genlmsghdr *genl = NLMSG_DATA(nl);
+    genl->cmd = cmd;
+    genl->version = 1;
+    struct nlattr *na = (struct nlattr *)((char *)genl + GENL_HDRLEN);
+    na->nla_type = attr;
+    na->nla_len = NLA_HDRLEN + len;
+    memcpy((char *)na + NLA_HDRLEN, data, len);
+    return NLMSG_ALIGN(nl->nlmsg_len);
+}
+
+static void taskstats_open(void) {
+    g_taskstats.tried = 1;
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC);
+    if (fd < 0) return;
+    struct sockaddr_nl addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return;
+    }
+    
+    /* Resolve the family id */
+    static union {
+        struct nlmsghdr hdr;
+        char raw[4096];
+    } msg;
+    size_t len = genl_put_request(msg.raw, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 0, CTRL_ATTR_FAMILY_NAME,
+                                  TASKSTATS_GENL_NAME, sizeof(TASKSTATS_GENL_NAME));
+    ssize_t got = send(fd, msg.raw, len, 0) < 0 ? -1 : recv(fd, &msg, sizeof(msg), MSG_DONTWAIT);
+    if (got <= 0 || !NLMSG_OK(&msg.hdr, (size_t)got) || msg.hdr.nlmsg_type == NLMSG_ERROR) {
+        close(fd);
+        return;
+    }
+    int attr_len = (int)msg.hdr.nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+    struct nlattr *na = (struct nlattr *)((char *)NLMSG_DATA(&msg.hdr) + GENL_HDRLEN);
+    while (attr_len >= NLA_HDRLEN && na->nla_len >= NLA_HDRLEN && na->nla_len <= attr_len) {
+        if (na->nla_type == CTRL_ATTR_FAMILY_ID) {
+            uint16_t id;
+            memcpy(&id, (char *)na + NLA_HDRLEN, sizeof(id));
+            g_taskstats.family = id;
+        }
+        attr_len -= NLA_ALIGN(na->nla_len);
+        na = (struct nlattr *)((char *)na + NLA_ALIGN(na->nla_len));
+    }
+    if (g_taskstats.family == 0) {
+        close(fd);
+        return;
+    }
+    g_taskstats.fd = fd;
+}
+
+/* Turn the totals of one reply into per-second rates for processes[i] */
+static void taskstats_apply(int i, const struct taskstats *ts, int64_t now) {
+    ProcessInfo *proc = &g_sample.processes[i];
+    int slot = pid_index_find(&g_proc_cache.index, proc->pid);
+    if (slot < 0 || slot >= g_proc_cache.count) return;
+    ProcCacheEntry *e = &g_proc_cache.entries[slot];
+    
+    unsigned long long totals[NUM_DELAYS] = {
+        ts->cpu_delay_total, ts->blkio_delay_total, ts->swapin_delay_total, ts->freepages_delay_total,
+    };
+    /* A reused PID restarts from its own totals */
+    int fresh = e->delay_stamp_ms == 0 || e->starttime != proc->starttime || now <= e->delay_stamp_ms;
+    for (int d = 0; d < NUM_DELAYS; d++) {
+        if (!fresh && totals[d] >= e->delay_ns[d]) {
+            proc->delay[d] = (totals[d] - e->delay_ns[d]) / 1e6f * 1000.0f / (now - e->delay_stamp_ms);
+        }
+        e->delay_ns[d] = totals[d];
+    }
+    e->starttime = proc->starttime;
+    e->delay_stamp_ms = now;
+}
+
+/* Query rows[0..count) of g_sample.processes, TASKSTATS_BATCH per send() */
+static void taskstats_query(const int *rows, int count) {
+    static union {
+        struct nlmsghdr hdr;
+        char raw[TASKSTATS_BATCH * TASKSTATS_REQ_SIZE > 8192 ? TASKSTATS_BATCH * TASKSTATS_REQ_SIZE : 8192];
+    } msg;
+    int64_t now = get_time_ms();
+    
+    for (int first = 0; first < count; first += TASKSTATS_BATCH) {
+        int batch = count - first < TASKSTATS_BATCH ? count - first : TASKSTATS_BATCH;
+        size_t len = 0;
+        for (int k = 0; k < batch; k++) {
+            uint32_t pid = g_sample.processes[rows[first + k]].pid;
+            len += genl_put_request(msg.raw + len, g_taskstats.family, TASKSTATS_CMD_GET, k,
+                                    TASKSTATS_CMD_ATTR_TGID, &pid, sizeof(pid));
+        }
+        if (send(g_taskstats.fd, msg.raw, len, 0) < 0) return;
+        
+        /* One reply (or error, for a PID that is gone) per request */
+        for (int replies = 0; replies < batch; replies++) {
+            ssize_t got = recv(g_taskstats.fd, &msg, sizeof(msg), MSG_DONTWAIT);
+            if (got <= 0) break;
+            if (!NLMSG_OK(&msg.hdr, (size_t)got) || msg.hdr.nlmsg_type == NLMSG_ERROR) continue;
+            int k = (int)msg.hdr.nlmsg_seq;
+            if (k < 0 || k >= batch) continue;
+            
+            /* TASKSTATS_TYPE_AGGR_TGID nests TASKSTATS_TYPE_TGID and TASKSTATS_TYPE_STATS */
+            int attr_len = (int)msg.hdr.nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+            struct nlattr *na = (struct nlattr *)((char *)NLMSG_DATA(&msg.hdr) + GENL_HDRLEN);
+            while (attr_len >= NLA_HDRLEN && na->nla_len >= NLA_HDRLEN && na->nla_len <= attr_len) {
+                if (na->nla_type == TASKSTATS_TYPE_AGGR_TGID) {
+                    int nested_len = na->nla_len - NLA_HDRLEN;
+                    struct nlattr *nn = (struct nlattr *)((char *)na + NLA_HDRLEN);
+                    while (nested_len >= NLA_HDRLEN && nn->nla_len >= NLA_HDRLEN && nn->nla_len <= nested_len) {
+                        if (nn->nla_type == TASKSTATS_TYPE_STATS) {
+                            /* The payload is only 4-byte aligned */
+                            struct taskstats ts;
+                            memset(&ts, 0, sizeof(ts));
+                            size_t n = nn->nla_len - NLA_HDRLEN;
+                            memcpy(&ts, (char *)nn + NLA_HDRLEN, n < sizeof(ts) ? n : sizeof(ts));
+                            taskstats_apply(rows[first + k], &ts, now);
+                        }
+                        nested_len -= NLA_ALIGN(nn->nla_len);
+                        nn = (struct nlattr *)((char *)nn + NLA_ALIGN(nn->nla_len));
+                    }
+                }
+                attr_len -= NLA_ALIGN(na->nla_len);
+                na = (struct nlattr *)((char *)na + NLA_ALIGN(na->nla_len));
+            }
+        }
+    }
+}
+#endif
+
+/* Fill the taskstats delays of the fresh sample for whatever uses them */
+static void taskstats_collect(void) {
+#ifdef HAVE_TASKSTATS
+    int use = column_source_use(COLSRC_TASKSTATS);
+    if (!use) return;
+    if (!g_taskstats.tried) taskstats_open();
+    if (g_taskstats.fd < 0) return;
+    
+    int n = g_sample.process_count;
+    if (g_taskstats.capacity < n) {
+        int *rows = realloc(g_taskstats.rows, sizeof(int) * n);
+        if (!rows) return;
+        g_taskstats.rows = rows;
+        g_taskstats.capacity = n;
+    }
+    int count = 0;
+    if (use == 2) {
+        for (int i = 0; i < n; i++) g_taskstats.rows[count++] = i;
+    } else if (g_scan_pass.have_sample_index) {
+        pthread_mutex_lock(&g_in_view.lock);
+        for (int k = 0; k < g_in_view.count && count < n; k++) {
+            int i = pid_index_find(&g_scan_pass.sample_index, g_in_view.pids[k]);
+            if (i >= 0) g_taskstats.rows[count++] = i;
+        }
+        pthread_mutex_unlock(&g_in_view.lock);
+    }
+    taskstats_query(g_taskstats.rows, count);
+#endif
+}
+
+/* Threads of the processes the UI expanded, read from task/<tid>/stat after
+ * each pass. Only those are enumerated, so the cost follows what is on
+ * screen rather than the host's thread count. */
+#define THREADS_PER_PROC_MAX 4096
+
+static ThreadInfo *g_prev_threads = NULL;
+static int g_prev_thread_count = 0;
+static int g_prev_thread_capacity = 0;
+static PidIndex g_prev_thread_index;    /* TID -> index into g_prev_threads */
+
+static int parse_thread_stat(const char *line, ThreadInfo *t) {
+    const char *p = strchr(line, '(');
+    const char *end = strrchr(line, ')');
+    if (!p || !end || end < p) return -1;
+    size_t len = end - p - 1;
+    if (len >= sizeof(t->name)) len = sizeof(t->name) - 1;
+    memcpy(t->name, p + 1, len);
+    t->name[len] = '\0';
+    
+    /* state(3), then utime(14), stime(15), starttime(22), processor(39) */
+    const char *tp = tok_skip_ws(end + 1);
+    t->state = *tp ? *tp++ : '?';
+    tp = tok_skip_fields(tp, 10);
+    t->prev_utime = (long)tok_ull(&tp);
+    t->prev_stime = (long)tok_ull(&tp);
+    tp = tok_skip_fields(tp, 6);
+    t->starttime = tok_ull(&tp);
+    tp = tok_skip_fields(tp, 16);
+    t->processor = (short)tok_ll(&tp);
+    return 0;
+}
+
+/* Busiest first, then by TID */
+static int cmp_thread_cpu(const void *a, const void *b) {
+    const ThreadInfo *ta = a, *tb = b;
+    if (tb->cpu_percent > ta->cpu_percent) return 1;
+    if (tb->cpu_percent < ta->cpu_percent) return -1;
+    return ta->tid - tb->tid;
+}
+
+static void collect_threads(void) {
+    /* Same generation swap as the process table */
+    ThreadInfo *spare = g_prev_threads;
+    int spare_capacity = g_prev_thread_capacity;
+    g_prev_threads = g_sample.threads;
+    g_prev_thread_capacity = g_sample.thread_capacity;
+    g_prev_thread_count = g_sample.thread_count;
+    g_sample.threads = spare;
+    g_sample.thread_capacity = spare_capacity;
+    g_sample.thread_count = 0;
+    
+    int pids[IN_VIEW_MAX];
+    pthread_mutex_lock(&g_in_view.lock);
+    int count = g_in_view.expanded_count;
+    memcpy(pids, g_in_view.expanded, sizeof(int) * count);
+    pthread_mutex_unlock(&g_in_view.lock);
+    if (count == 0) return;
+    
+    int have_prev = (pid_index_reset(&g_prev_thread_index, g_prev_thread_count) == 0);
+    for (int j = 0; have_prev && j < g_prev_thread_count; j++) {
+        pid_index_insert(&g_prev_thread_index, g_prev_threads[j].tid, j);
+    }
+    
+    ScanPass *sp = &g_scan_pass;
+    char path[32], buf[1024];
+    for (int k = 0; k < count; k++) {
+        if (!sp->have_sample_index || pid_index_find(&sp->sample_index, pids[k]) < 0) continue;
+        snprintf(path, sizeof(path), "%d/task", pids[k]);
+        int task_fd = openat(g_proc_cache.proc_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (task_fd < 0) continue;
+        DIR *dir = fdopendir(task_fd);
+        if (!dir) {
+            close(task_fd);
+            continue;
+        }
+        
+        int first = g_sample.thread_count;
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL && g_sample.thread_count - first < THREADS_PER_PROC_MAX) {
+            int tid = atoi(entry->d_name);
+            if (tid <= 0) continue;
+            if (reserve_threads(&g_sample.threads, &g_sample.thread_capacity, g_sample.thread_count + 1) != 0) break;
+            ThreadInfo *t = &g_sample.threads[g_sample.thread_count];
+            snprintf(path, sizeof(path), "%d/stat", tid);
+            if (read_file_at(task_fd, path, buf, sizeof(buf)) <= 0 || parse_thread_stat(buf, t) != 0) continue;
+            t->tid = tid;
+            t->pid = pids[k];
+            t->cpu_percent = 0.0f;
+            
+            int j = have_prev ? pid_index_find(&g_prev_thread_index, tid) : -1;
+            if (j >= 0 && g_prev_threads[j].starttime == t->starttime &&
+                g_sample.num_cores > 0 && g_elapsed_seconds > 0) {
+                long delta = (t->prev_utime - g_prev_threads[j].prev_utime) +
+                             (t->prev_stime - g_prev_threads[j].prev_stime);
+                t->cpu_percent = (delta * 100.0f) / (g_clk_tck * g_elapsed_seconds * g_sample.num_cores);
+            }
+            g_sample.thread_count++;
+        }
+        closedir(dir);
+        qsort(g_sample.threads + first, g_sample.thread_count - first, sizeof(ThreadInfo), cmp_thread_cpu);
+    }
+}
+
+void parse_processes(void) {
+    if (!g_proc_events.tried) proc_events_open();
+    proc_events_drain();
+    if (proc_scan_begin(&g_scanner) != 0) return;
+    if (g_proc_cache.budget < 0) proc_cache_init_budget(&g_proc_cache, fd_reserve());
+    g_proc_cache.proc_fd = g_scanner.proc_fd;
+    g_proc_cache.pass++;
+    
+    ScanPass *sp = &g_scan_pass;
+    if (sp->page_kb <= 0) sp->page_kb = sysconf(_SC_PAGESIZE) / 1024;
+    if (sp->page_kb <= 0) sp->page_kb = 4;
+    if (g_clk_tck <= 0) g_clk_tck = sysconf(_SC_CLK_TCK);
+    if (g_clk_tck <= 0) g_clk_tck = 100;
+    
+    /* Swap generations: the last sample becomes the previous one for CPU deltas
+     * and its old buffer is refilled below */
+    ProcessInfo *spare = g_prev_procs;
+    int spare_capacity = g_prev_proc_capacity;
+    g_prev_procs = g_sample.processes;
+    g_prev_proc_capacity = g_sample.process_capacity;
+    g_prev_proc_count = g_sample.process_count;
+    g_sample.processes = spare;
+    g_sample.process_capacity = spare_capacity;
+    
+    /* The index built over the last sample now indexes the previous one, so
+     * each delta lookup is O(1) */
+    PidIndex spare_index = sp->prev_index;
+    sp->prev_procs = g_prev_procs;
+    sp->prev_index = sp->sample_index;
+    sp->have_index = sp->have_sample_index;
+    sp->sample_index = spare_index;
+    
+    /* List the PIDs, from proc events when they are live, and give each a
+     * cache entry up front; the workers then only touch their own entries and
+     * never grow the shared tables */
+    int64_t now = get_time_ms();
+    int n = proc_events_list(sp, now);
+    if (n < 0) {
+        n = 0;
+        const char *entry_name;
+        while ((entry_name = proc_scan_next(&g_scanner)) != NULL) {
+            if (reserve_scan_pass(sp, n + 1) != 0) break;
+            sp->pids[n++] = atoi(entry_name);
+        }
+        proc_events_rescanned(now);
+    }
+    if (reserve_processes(&g_sample.processes, &g_sample.process_capacity, n) != 0) {
+        n = g_sample.process_capacity;
+    }
+    for (int i = 0; i < n; i++) {
+        ProcCacheEntry *pce = proc_cache_get(&g_proc_cache, sp->pids[i]);
+        sp->cache_slot[i] = pce ? (int)(pce - g_proc_cache.entries) : -1;
+    }
+    
+    /* Sources some rows need, fixed for the whole pass */
+    sp->schedstat_use = column_source_use(COLSRC_SCHEDSTAT);
+    sp->schedstat_cpu = g_elapsed_seconds > 0 && g_elapsed_seconds * 1000 < SCHEDSTAT_CPU_BELOW_MS;
+    sp->io_use = column_source_use(COLSRC_IO);
+    sp->have_in_view = 0;
+    if (sp->schedstat_use == 1 || sp->io_use == 1) {
+        pthread_mutex_lock(&g_in_view.lock);
+        sp->have_in_view = (pid_index_reset(&sp->in_view, g_in_view.count) == 0);
+        for (int k = 0; sp->have_in_view && k < g_in_view.count; k++) {
+            pid_index_insert(&sp->in_view, g_in_view.pids[k], k);
+        }
+        pthread_mutex_unlock(&g_in_view.lock);
+    }
+    
+    sp->fd_dropped = 0;
+    scan_parallel(n);
+    g_sample.fd_dropped = sp->fd_dropped;
+    
+    /* Between listings the PID list comes from the last sample, so a process
+     * that is still there but could not be read would stay out of it until
+     * the next rescan; force that rescan for the next pass instead */
+    if (g_proc_events.fd >= 0 && !g_proc_events.lost) {
+        int missed = sp->fd_dropped > 0;
+        for (int i = 0; i < n && !missed; i++) {
+            if (sp->ok[i]) continue;
+            char entry_name[16];
+            snprintf(entry_name, sizeof(entry_name), "%d", sp->pids[i]);
+            missed = faccessat(g_scanner.proc_fd, entry_name, F_OK, 0) == 0;
+        }
+        if (missed) g_proc_events.lost = 1;
+    }
+    
+    /* Merge: close the gaps left by processes that vanished mid-scan */
+    int count = 0;
+    g_sample.running_count = 0;
+    for (int i = 0; i < n; i++) {
+        if (!sp->ok[i]) continue;
+        if (count != i) g_sample.processes[count] = g_sample.processes[i];
+        if (g_sample.processes[count].state == 'R') g_sample.running_count++;
+        count++;
+    }
+    g_sample.process_count = count;
+    
+    sp->have_sample_index = (pid_index_reset(&sp->sample_index, count) == 0);
+    if (sp->have_sample_index) {
+        for (int j = 0; j < count; j++) {
+            pid_index_insert(&sp->sample_index, g_sample.processes[j].pid, j);
+        }
     }
     
-    g_stats.net_history_rx[g_stats.history_index] = (int)(g_stats.net_rx_speed / 100);
-    g_stats.net_history_tx[g_stats.history_index] = (int)(g_stats.net_tx_speed / 100);
+    taskstats_collect();
+    collect_threads();
     
-    g_stats.prev_net_rx = total_rx;
-    g_stats.prev_net_tx = total_tx;
+    proc_cache_sweep(&g_proc_cache);
+    g_sample.proc_generation++;
 }
 
-static unsigned int get_sector_size(const char *name) {
-    char path[128];
-    snprintf(path, sizeof(path), "/sys/block/%s/queue/hw_sector_size", name);
-    FILE *fp = fopen(path, "r");
-    if (!fp) return 512;
-    unsigned int size = 512;
-    fscanf(fp, "%u", &size);
-    fclose(fp);
-    return size > 0 ? size : 512;
+/* Collector scheduling: each collector has its own interval and deadline and
+ * only runs while something consumes it. Its parser sees the time since its own
+ * last sample in g_elapsed_seconds, so the first delta after a pane is shown
+ * again spans the whole hidden period and stays a valid average. */
+typedef struct {
+    const char *name;           /* Config key: <name>_interval */
+    void (*sample)(void);
+    int (*wanted)(void);
+    int (*changed)(void);       /* Set for collectors sampled only on change */
+    int interval_ms;            /* 0 follows refresh_rate */
+    int64_t last_sample_ms;     /* 0 until the first sample */
+    int64_t next_due_ms;
+} Collector;
+
+/* Pane flags are written by the UI thread and read here on the collector's */
+static inline int shown(const int *pane) { return __atomic_load_n(pane, __ATOMIC_RELAXED); }
+
+/* The process list needs num_cores and total_mem, which only change on hotplug */
+static int want_cpu(void) { return shown(&g_show_cpu) || (shown(&g_show_proc) && g_sample.num_cores == 0); }
+static int want_mem(void) { return shown(&g_show_mem) || (shown(&g_show_proc) && g_sample.total_mem == 0); }
+static int want_net(void) { return shown(&g_show_net); }
+static int want_disks(void) { return shown(&g_show_disks); }
+static int want_always(void) { return 1; }  /* Battery is in the top bar */
+static int want_proc(void) { return shown(&g_show_proc); }
+
+/* Run order matters: processes use the CPU and memory totals, disks the mounts */
+static Collector g_collectors[] = {
+    {"cpu", parse_cpu_stats, want_cpu, NULL, CPU_INTERVAL_MS, 0, 0},
+    {"mem", parse_meminfo, want_mem, NULL, 0, 0, 0},
+    {"net", parse_net_stats, want_net, NULL, 0, 0, 0},
+    {"mounts", parse_mounts, want_disks, mounts_changed, 0, 0, 0},
+    {"disk", parse_disk_stats, want_disks, NULL, 0, 0, 0},
+    {"battery", parse_battery, want_always, NULL, BATTERY_INTERVAL_MS, 0, 0},
+    {"proc", parse_processes, want_proc, NULL, PROC_INTERVAL_MS, 0, 0},
+};
+static const int NUM_COLLECTORS = sizeof(g_collectors) / sizeof(g_collectors[0]);
+
+static int collector_interval(const Collector *c) {
+    return c->interval_ms > 0 ? c->interval_ms : g_refresh_rate_ms;
 }
 
-void parse_disk_stats(void) {
-    FILE *fp = fopen("/proc/diskstats", "r");
-    if (!fp) return;
-    
-    char line[256];
-    DiskInfo new_disks[MAX_DISKS];
-    int new_disk_count = 0;
-    
-    while (fgets(line, sizeof(line), fp) && new_disk_count < MAX_DISKS) {
-        char name[32];
-        unsigned long long read_sectors, write_sectors;
-        
-        if (sscanf(line, "%*d %*d %s %*u %*u %llu %*u %*u %*u %llu",
-                   name, &read_sectors, &write_sectors) == 3) {
-            
-            if (strncmp(name, "loop", 4) == 0 || 
-                strncmp(name, "ram", 3) == 0 ||
-                strncmp(name, "dm-", 3) == 0) continue;
-            
-            unsigned int sector_size = get_sector_size(name);
-            
-            DiskInfo *disk = &new_disks[new_disk_count];
-            memset(disk, 0, sizeof(DiskInfo));
-            strncpy(disk->name, name, sizeof(disk->name) - 1);
-            
-            for (int i = 0; i < g_stats.num_disks; i++) {
-                if (strcmp(g_stats.disks[i].name, name) == 0) {
-                    unsigned long long read_diff = (read_sectors - g_stats.disks[i].read_sectors) * sector_size;
-                    unsigned long long write_diff = (write_sectors - g_stats.disks[i].write_sectors) * sector_size;
-                    disk->read_speed = read_diff / 1024.0f;
-                    disk->write_speed = write_diff / 1024.0f;
-                    memcpy(disk->history_rx, g_stats.disks[i].history_rx, sizeof(disk->history_rx));
-                    memcpy(disk->history_tx, g_stats.disks[i].history_tx, sizeof(disk->history_tx));
-                    break;
-                }
-            }
-            
-            disk->read_sectors = read_sectors;
-            disk->write_sectors = write_sectors;
-            disk->history_rx[g_stats.history_index] = (int)(disk->read_speed / 100);
-            disk->history_tx[g_stats.history_index] = (int)(disk->write_speed / 100);
-            
-            new_disk_count++;
+static void run_collector(Collector *c, int64_t now) {
+    g_elapsed_seconds = c->last_sample_ms > 0 ? (now - c->last_sample_ms) / 1000.0f : 0.0f;
+    c->sample();
+    c->last_sample_ms = now;
+    c->next_due_ms = now + (c->changed ? EVENT_CHECK_MS : collector_interval(c));
+}
+
+/* Sample every wanted collector whose deadline has passed (or, for change-driven
+ * ones, whose source changed). A collector hidden past its deadline is due as
+ * soon as it is wanted again. Returns the number of collectors sampled. */
+int run_due_collectors(int64_t now) {
+    int sampled = 0;
+    for (int i = 0; i < NUM_COLLECTORS; i++) {
+        Collector *c = &g_collectors[i];
+        if (!c->wanted()) continue;
+        if (c->changed) {
+            if (now < c->next_due_ms) continue;
+            c->next_due_ms = now + EVENT_CHECK_MS;
+            if (c->last_sample_ms > 0 && !c->changed()) continue;
+        } else if (now < c->next_due_ms) {
+            continue;
         }
+        run_collector(c, now);
+        sampled++;
     }
-    fclose(fp);
-    
-    memcpy(g_stats.disks, new_disks, sizeof(new_disks[0]) * new_disk_count);
-    g_stats.num_disks = new_disk_count;
+    return sampled;
 }
 
-void parse_battery(void) {
-    DIR *dir = opendir("/sys/class/power_supply");
-    if (!dir) {
-        g_stats.battery_present = 0;
-        return;
+/* Earliest deadline among wanted collectors */
+int64_t next_collector_deadline(int64_t now) {
+    int64_t next = now + EVENT_CHECK_MS;
+    for (int i = 0; i < NUM_COLLECTORS; i++) {
+        if (g_collectors[i].wanted() && g_collectors[i].next_due_ms < next) {
+            next = g_collectors[i].next_due_ms;
+        }
     }
-    
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (strncmp(entry->d_name, "BAT", 3) != 0) continue;
-        
-        char path[512];
-        
-        snprintf(path, sizeof(path), "/sys/class/power_supply/%s/capacity", entry->d_name);
-        FILE *fp = fopen(path, "r");
-        if (fp) {
-            fscanf(fp, "%d", &g_stats.battery_percent);
-            fclose(fp);
-            g_stats.battery_present = 1;
+    return next;
+}
+
+/* Snapshot handoff between the collector and UI threads, triple-buffered:
+ * the collector fills the back slot and swaps it with the middle one, the UI
+ * swaps its front slot with the middle one when that holds a newer sample.
+ * Both swaps are a single atomic exchange, so neither side ever waits. */
+#define SNAP_INDEX 3
+#define SNAP_FRESH 4            /* Middle slot was published since the UI last took it */
+
+typedef struct {
+    SystemStats stats;          /* processes and disks point into this slot */
+    ProcessInfo *procs;
+    int proc_count;
+    int proc_capacity;
+    unsigned int proc_generation;   /* Of the table held in procs */
+    ThreadInfo *threads;        /* Sampled with the process table */
+    int thread_count;
+    int thread_capacity;
+    DiskInfo disks[MAX_DISKS];
+} Snapshot;
+
+static Snapshot g_snapshots[3];
+static int g_snap_back = 0;         /* Collector's slot */
+static int g_snap_middle = 1;       /* Shared; SNAP_FRESH set on publish */
+static int g_snap_front = 2;        /* UI's slot */
+
+/* Copy g_sample into the back slot and publish it */
+static void publish_snapshot(void) {
+    Snapshot *snap = &g_snapshots[g_snap_back];
+    
+    /* A slot keeps its process table until a scan produces a newer one; if
+     * that cannot be copied, the slot goes out with its older table */
+    if (snap->proc_generation != g_sample.proc_generation &&
+        reserve_processes(&snap->procs, &snap->proc_capacity, g_sample.process_count) == 0) {
+        if (g_sample.process_count > 0) {
+            memcpy(snap->procs, g_sample.processes, sizeof(ProcessInfo) * g_sample.process_count);
         }
-        
-        snprintf(path, sizeof(path), "/sys/class/power_supply/%s/status", entry->d_name);
-        fp = fopen(path, "r");
-        if (fp) {
-            fgets(g_stats.battery_status, sizeof(g_stats.battery_status), fp);
-            g_stats.battery_status[strcspn(g_stats.battery_status, "\n")] = '\0';
-            fclose(fp);
+        snap->proc_count = g_sample.process_count;
+        snap->proc_generation = g_sample.proc_generation;
+        snap->thread_count = 0;
+        if (g_sample.thread_count > 0 &&
+            reserve_threads(&snap->threads, &snap->thread_capacity, g_sample.thread_count) == 0) {
+            memcpy(snap->threads, g_sample.threads, sizeof(ThreadInfo) * g_sample.thread_count);
+            snap->thread_count = g_sample.thread_count;
         }
-        break;
     }
-    closedir(dir);
+    if (g_sample.num_disks > 0) {
+        memcpy(snap->disks, g_sample.disks, sizeof(DiskInfo) * g_sample.num_disks);
+    }
+    
+    snap->stats = g_sample;
+    snap->stats.processes = snap->procs;
+    snap->stats.process_count = snap->proc_count;
+    snap->stats.process_capacity = snap->proc_capacity;
+    snap->stats.proc_generation = snap->proc_generation;
+    snap->stats.threads = snap->threads;
+    snap->stats.thread_count = snap->thread_count;
+    snap->stats.thread_capacity = snap->thread_capacity;
+    snap->stats.disks = snap->disks;
+    
+    int prev = __atomic_exchange_n(&g_snap_middle, g_snap_back | SNAP_FRESH, __ATOMIC_ACQ_REL);
+    g_snap_back = prev & SNAP_INDEX;
 }
 
-int compare_processes(const void *a, const void *b) {
-    const ProcessInfo *pa = (const ProcessInfo *)a;
-    const ProcessInfo *pb = (const ProcessInfo *)b;
-    
-    switch (g_sort_mode) {
-        case SORT_CPU_DIRECT:
-            if (pb->cpu_percent > pa->cpu_percent) return 1;
-            if (pb->cpu_percent < pa->cpu_percent) return -1;
-            break;
-        case SORT_CPU_LAZY:
-            if (pb->cpu_percent_lazy > pa->cpu_percent_lazy) return 1;
-            if (pb->cpu_percent_lazy < pa->cpu_percent_lazy) return -1;
-            break;
-        case SORT_MEM:
-            if (pb->mem_rss > pa->mem_rss) return 1;
-            if (pb->mem_rss < pa->mem_rss) return -1;
-            break;
-        case SORT_PID:
-            if (pa->pid > pb->pid) return 1;
-            if (pa->pid < pb->pid) return -1;
-            break;
-        case SORT_NAME:
-            return strcasecmp(pa->name, pb->name);
-    }
-    
-    /* Secondary sort by PID for stable ordering */
-    if (pa->pid > pb->pid) return 1;
-    if (pa->pid < pb->pid) return -1;
-    return 0;
+/* UI side: switch to the newest published snapshot, if there is one. A new
+ * process table re-targets the display order and the detail cache. Returns 1
+ * if g_stats changed. */
+int adopt_snapshot(void) {
+    if (!(__atomic_load_n(&g_snap_middle, __ATOMIC_ACQUIRE) & SNAP_FRESH)) return 0;
+    
+    /* The rows' PIDs must be saved while the old table is still ours */
+    view_save_pids();
+    int prev = __atomic_exchange_n(&g_snap_middle, g_snap_front, __ATOMIC_ACQ_REL);
+    g_snap_front = prev & SNAP_INDEX;
+    
+    unsigned int shown_generation = g_stats.proc_generation;
+    g_stats = g_snapshots[g_snap_front].stats;
+    if (g_stats.proc_generation != shown_generation) {
+        user_cache_revalidate();
+        view_remap();
+        detail_cache_retain();
+    }
+    if (g_stats.process_count > g_view.count) g_stats.process_count = g_view.count;
+    return 1;
 }
 
-void parse_processes(void) {
-    DIR *dir = opendir("/proc");
-    if (!dir) return;
-    
-    struct dirent *entry;
-    
-    /* Save previous process list for CPU delta calculation */
-    ProcessInfo prev_procs[MAX_PROCESSES];
-    int prev_count = g_stats.process_count;
-    memcpy(prev_procs, g_stats.processes, sizeof(ProcessInfo) * prev_count);
-    
-    g_stats.process_count = 0;
-    g_stats.running_count = 0;
-    
-    while ((entry = readdir(dir)) != NULL && g_stats.process_count < MAX_PROCESSES) {
-        if (!is_number(entry->d_name)) continue;
-        
-        char path[512];
-        snprintf(path, sizeof(path), "/proc/%s/stat", entry->d_name);
-        
-        FILE *fp = fopen(path, "r");
-        if (!fp) continue;
-        
-        char line[1024];
-        if (fgets(line, sizeof(line), fp)) {
-            ProcessInfo *proc = &g_stats.processes[g_stats.process_count];
-            memset(proc, 0, sizeof(ProcessInfo));
-            
-            char *p = strchr(line, '(');
-            if (!p) { fclose(fp); continue; }
-            
-            sscanf(line, "%d", &proc->pid);
-            
-            char *end = strrchr(p, ')');
-            if (!end) { fclose(fp); continue; }
-            
-            int comm_len = end - p - 1;
-            if (comm_len < 0) comm_len = 0;
-            if (comm_len >= 255) comm_len = 255;
-            strncpy(proc->name, p + 1, comm_len);
-            proc->name[comm_len] = '\0';
-            
-            int ppid, pgrp, session, tty_nr, tpgid, uid = 0;
-            unsigned int flags;
-            unsigned long minflt, cminflt, majflt, cmajflt, utime, stime;
-            
-            sscanf(end + 2, "%c %d %d %d %d %d %u %lu %lu %lu %lu %lu %lu",
-                   &proc->state, &ppid, &pgrp, &session, &tty_nr, &tpgid,
-                   &flags, &minflt, &cminflt, &majflt, &cmajflt, &utime, &stime);
-            
-            /* Read UID and memory from /proc/[pid]/status - more reliable */
-            snprintf(path, sizeof(path), "/proc/%s/status", entry->d_name);
-            FILE *status_fp = fopen(path, "r");
-            if (status_fp) {
-                char status_line[256];
-                proc->mem_rss = 0;
-                uid = 0;
-                while (fgets(status_line, sizeof(status_line), status_fp)) {
-                    unsigned long val;
-                    if (sscanf(status_line, "VmRSS: %lu", &val) == 1) {
-                        proc->mem_rss = val;
-                    }
-                    /* Parse Uid line: "Uid: 1000 1000 1000 1000" */
-                    if (strncmp(status_line, "Uid:", 4) == 0) {
-                        sscanf(status_line, "Uid: %d", &uid);
-                    }
-                }
-                fclose(status_fp);
-            }
+/* Sample everything that is wanted right now, regardless of deadlines, and
+ * publish the result. Runs on the main thread before the collector starts. */
+void update_stats(void) {
+    int64_t now = get_time_ms();
+    for (int i = 0; i < NUM_COLLECTORS; i++) {
+        if (g_collectors[i].wanted()) run_collector(&g_collectors[i], now);
+    }
+    publish_snapshot();
+}
 
-            if (proc->uid != uid) {
-                proc->uid = uid;
-                get_username(uid, proc->user, sizeof(proc->user));
-            }
-            
-            snprintf(path, sizeof(path), "/proc/%s/cmdline", entry->d_name);
-            FILE *cmd_fp = fopen(path, "r");
-            if (cmd_fp) {
-                size_t n = fread(proc->cmdline, 1, sizeof(proc->cmdline) - 1, cmd_fp);
-                proc->cmdline[n] = '\0';
-                for (size_t i = 0; i < n; i++) {
-                    if (proc->cmdline[i] == '\0') proc->cmdline[i] = ' ';
-                }
-                fclose(cmd_fp);
-            }
-            
-            if (strlen(proc->cmdline) == 0) {
-                strncpy(proc->cmdline, proc->name, sizeof(proc->cmdline) - 1);
-            }
-            
-            proc->mem_percent = g_stats.total_mem > 0 ? 
-                (proc->mem_rss * 100.0f) / g_stats.total_mem : 0;
-            
-            /* Store current CPU times */
-            long current_utime = utime;
-            long current_stime = stime;
-            
-            /* Try to find previous values from saved processes */
-            proc->cpu_percent = 0.0f;
-            for (int j = 0; j < prev_count; j++) {
-                if (prev_procs[j].pid == proc->pid) {
-                    /* Found existing process - calculate CPU% from delta */
-                    long delta_utime = current_utime - prev_procs[j].prev_utime;
-                    long delta_stime = current_stime - prev_procs[j].prev_stime;
-                    long delta_total = delta_utime + delta_stime;
-                    
-                    /* CPU% = (delta_ticks / clock_ticks_per_second) / elapsed_seconds * 100 / num_cores */
-                    if (g_clk_tck <= 0) g_clk_tck = sysconf(_SC_CLK_TCK);
-                    if (g_clk_tck <= 0) g_clk_tck = 100;
-                    
-                    float cpu_raw = 0.0f;
-                    if (g_stats.num_cores > 0 && g_elapsed_seconds > 0) {
-                        cpu_raw = (delta_total * 100.0f) / (g_clk_tck * g_elapsed_seconds * g_stats.num_cores);
-                    }
-                    proc->cpu_percent = cpu_raw;
-                    
-                    /* Lazy mode: exponential moving average (smoothing factor 0.3) */
-                    if (proc->cpu_percent_lazy > 0 || cpu_raw > 0) {
-                        proc->cpu_percent_lazy = proc->cpu_percent_lazy * 0.7f + cpu_raw * 0.3f;
-                    } else {
-                        proc->cpu_percent_lazy = cpu_raw;
-                    }
-                    break;
-                }
-            }
-            
-            /* Store current values for next time */
-            proc->prev_utime = current_utime;
-            proc->prev_stime = current_stime;
-            
-            if (proc->state == 'R') {
-                g_stats.running_count++;
-            }
-            
-            g_stats.process_count++;
+/* Collector thread. It sleeps until the next collector is due or the UI wakes
+ * it (a pane was shown), and wakes the UI after each publish. */
+static pthread_t g_collector_thread;
+static int g_collector_wake[2] = {-1, -1};
+static int g_ui_wake[2] = {-1, -1};
+
+static void wake(int fd) {
+    char c = 1;
+    if (write(fd, &c, 1) < 0) {
+        /* Pipe full (EAGAIN): a wakeup is already pending */
+    }
+}
+
+static void drain(int fd) {
+    char buf[64];
+    while (read(fd, buf, sizeof(buf)) > 0) {}
+}
+
+static void *collector_main(void *arg) {
+    (void)arg;
+    while (__atomic_load_n(&g_running, __ATOMIC_RELAXED)) {
+        if (run_due_collectors(get_time_ms()) > 0) {
+            publish_snapshot();
+            wake(g_ui_wake[1]);
         }
         
-        fclose(fp);
+        int64_t now = get_time_ms();
+        int64_t wait = next_collector_deadline(now) - now;
+        if (wait < 0) wait = 0;
+        struct pollfd pfds[2] = {
+            {g_collector_wake[0], POLLIN, 0},
+            {g_proc_events.fd, POLLIN, 0},  /* Ignored by poll() while -1 */
+        };
+        if (poll(pfds, 2, (int)wait) > 0) {
+            if (pfds[0].revents & POLLIN) drain(g_collector_wake[0]);
+            if (pfds[1].revents & POLLIN) proc_events_drain();
+        }
     }
-    
-    closedir(dir);
-    qsort(g_stats.processes, g_stats.process_count, sizeof(ProcessInfo), compare_processes);
+    return NULL;
 }
 
-void update_stats(void) {
-    parse_cpu_stats();
-    parse_meminfo();
-    parse_net_stats();
-    parse_disk_stats();
-    parse_battery();
-    parse_processes();
-    g_stats.history_index = (g_stats.history_index + 1) % HISTORY_SIZE;
+static int make_wake_pipe(int fds[2]) {
+    if (pipe(fds) != 0) return -1;
+    for (int i = 0; i < 2; i++) {
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+        fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+    }
+    return 0;
+}
+
+int start_collector(void) {
+    if (make_wake_pipe(g_collector_wake) != 0 || make_wake_pipe(g_ui_wake) != 0) return -1;
+    return pthread_create(&g_collector_thread, NULL, collector_main, NULL) == 0 ? 0 : -1;
+}
+
+/* g_running must already be 0; a scan in progress is finished first */
+void stop_collector(void) {
+    wake(g_collector_wake[1]);
+    pthread_join(g_collector_thread, NULL);
 }
 
 /* Draw functions */
@@ -915,7 +4218,7 @@ void draw_memory_section(int x, int y, int w, int h) {
         if (graph_h > 3) graph_h = 3;
         if (graph_h < 1) graph_h = 1;
         draw_graph(x, line, w - 2, graph_h, (float*)g_stats.mem_history, 
-                   g_stats.history_index, COLOR_MEM);
+                   g_stats.mem_history_index, COLOR_MEM);
     }
 }
 
@@ -938,6 +4241,14 @@ void draw_disk_section(int x, int y, int w, int h) {
         /* Disk name */
         tb_printf(disk_x, line, COLOR_DISK | TB_BOLD, COLOR_BG, "%-8s", disk->name);
         
+        /* Filesystem usage of mounted disks */
+        if (disk->total > 0 && disk_width > 14) {
+            int used_pct = (int)(disk->used * 100 / disk->total);
+            uint32_t used_color = used_pct > 80 ? COLOR_HIGH :
+                                  used_pct > 50 ? COLOR_MED : COLOR_LOW;
+            tb_printf(disk_x + 9, line, used_color, COLOR_BG, "%3d%%", used_pct);
+        }
+        
         /* Read speed */
         if (line + 1 < max_line) {
             tb_printf(disk_x, line + 1, COLOR_NET_DOWN, COLOR_BG, "▼");
@@ -966,7 +4277,7 @@ void draw_disk_section(int x, int y, int w, int h) {
             }
             
             draw_graph(disk_x, line + 3, graph_w, graph_h, combined_history, 
-                       g_stats.history_index, COLOR_DISK);
+                       g_stats.disk_history_index, COLOR_DISK);
         }
         
         /* Move to next row of disks if we've filled this one */
@@ -999,7 +4310,7 @@ void draw_net_section(int x, int y, int w, int h) {
         if (graph_h > 2) graph_h = 2;
         if (graph_h > 0) {
             draw_graph(x, line, w - 2, graph_h, (float*)g_stats.net_history_rx, 
-                       g_stats.history_index, COLOR_NET_DOWN);
+                       g_stats.net_history_index, COLOR_NET_DOWN);
             line += graph_h;
         }
     }
@@ -1017,17 +4328,112 @@ void draw_net_section(int x, int y, int w, int h) {
         if (graph_h > 2) graph_h = 2;
         if (graph_h > 0) {
             draw_graph(x, line, w - 2, graph_h, (float*)g_stats.net_history_tx,
-                       g_stats.history_index, COLOR_NET_UP);
+                       g_stats.net_history_index, COLOR_NET_UP);
         }
     }
 }
 
 /* Process list */
+/* How a process ended, from its wait() status */
+static void format_exit_status(int status, char *buf, size_t buflen) {
+    if (!WIFSIGNALED(status)) {
+        snprintf(buf, buflen, "exit %d", WEXITSTATUS(status));
+        return;
+    }
+    const char *name = NULL;
+    switch (WTERMSIG(status)) {
+        case SIGHUP: name = "SIGHUP"; break;
+        case SIGINT: name = "SIGINT"; break;
+        case SIGQUIT: name = "SIGQUIT"; break;
+        case SIGILL: name = "SIGILL"; break;
+        case SIGABRT: name = "SIGABRT"; break;
+        case SIGBUS: name = "SIGBUS"; break;
+        case SIGFPE: name = "SIGFPE"; break;
+        case SIGKILL: name = "SIGKILL"; break;
+        case SIGSEGV: name = "SIGSEGV"; break;
+        case SIGPIPE: name = "SIGPIPE"; break;
+        case SIGALRM: name = "SIGALRM"; break;
+        case SIGTERM: name = "SIGTERM"; break;
+    }
+    if (name) snprintf(buf, buflen, "%s", name);
+    else snprintf(buf, buflen, "SIG%d", WTERMSIG(status));
+}
+
+/* Recently exited processes, newest first, in place of the process rows */
+void draw_exited_list(int x, int y, int w, int h) {
+    int list_start = y + 2;
+    int max_line = y + h - 1;
+    
+    int pid_width = PROC_PID_WIDTH;
+    int status_width = 9;
+    int time_width = 6;
+    int show_parent = w >= 70;
+    int prog_width = w - pid_width - status_width - 2 * time_width - 4 - (show_parent ? pid_width + 1 : 0);
+    if (prog_width < PROC_PROG_MIN_WIDTH) prog_width = PROC_PROG_MIN_WIDTH;
+    
+    int cx = x;
+    tb_printf(cx, list_start - 1, COLOR_HEADER | TB_BOLD, COLOR_BG, "%-*s", pid_width, "Pid:");
+    cx += pid_width + 1;
+    tb_printf(cx, list_start - 1, COLOR_HEADER | TB_BOLD, COLOR_BG, "%-*s", prog_width, "Program:");
+    cx += prog_width + 1;
+    if (show_parent) {
+        tb_printf(cx, list_start - 1, COLOR_HEADER | TB_BOLD, COLOR_BG, "%-*s", pid_width, "Parent:");
+        cx += pid_width + 1;
+    }
+    tb_printf(cx, list_start - 1, COLOR_HEADER | TB_BOLD, COLOR_BG, "%-*s", status_width, "Status:");
+    cx += status_width + 1;
+    tb_printf(cx, list_start - 1, COLOR_HEADER | TB_BOLD, COLOR_BG, "%-*s", time_width, "Lived");
+    cx += time_width + 1;
+    tb_printf(cx, list_start - 1, COLOR_HEADER | TB_BOLD, COLOR_BG, "%-*s", time_width, "Ago");
+    
+    int64_t now = get_time_ms();
+    for (int i = 0; i < g_stats.exited_count && list_start + i < max_line; i++) {
+        const ExitedProc *e = &g_stats.exited[(g_stats.exited_head - 1 - i + EXITED_MAX) % EXITED_MAX];
+        int row = list_start + i;
+        char status[16], lived[16], ago[16];
+        format_exit_status(e->status, status, sizeof(status));
+        if (e->lifetime_ms >= 0) format_duration(e->lifetime_ms, lived, sizeof(lived));
+        else snprintf(lived, sizeof(lived), "-");
+        format_duration(now - e->exit_ms, ago, sizeof(ago));
+        
+        uint32_t status_color = WIFSIGNALED(e->status) ? COLOR_HIGH :
+                                WEXITSTATUS(e->status) != 0 ? COLOR_MED : COLOR_FG;
+        
+        cx = x;
+        tb_printf(cx, row, COLOR_FG, COLOR_BG, "%-*d", pid_width, e->pid);
+        cx += pid_width + 1;
+        tb_printf(cx, row, COLOR_FG, COLOR_BG, "%-*.*s", prog_width, prog_width, e->name[0] ? e->name : "?");
+        cx += prog_width + 1;
+        if (show_parent) {
+            tb_printf(cx, row, COLOR_FG, COLOR_BG, "%-*d", pid_width, e->ppid);
+            cx += pid_width + 1;
+        }
+        tb_printf(cx, row, status_color, COLOR_BG, "%-*s", status_width, status);
+        cx += status_width + 1;
+        tb_printf(cx, row, COLOR_FG, COLOR_BG, "%-*s", time_width, lived);
+        cx += time_width + 1;
+        tb_printf(cx, row, COLOR_FG, COLOR_BG, "%-*s", time_width, ago);
+    }
+    
+    if (max_line > y + 2) {
+        if (g_stats.proc_events) {
+            tb_printf(x, max_line, COLOR_FG, COLOR_BG, "%d exited | x:back", g_stats.exited_count);
+        } else {
+            tb_printf(x, max_line, COLOR_FG, COLOR_BG, "Exit tracking needs root or CAP_NET_ADMIN | x:back");
+        }
+    }
+}
+
 void draw_process_list(int x, int y, int w, int h) {
     draw_section_header(x, y, 5, "proc", COLOR_PROC);
     
     if (h < 5) return;
     
+    if (g_show_exited) {
+        draw_exited_list(x, y, w, h);
+        return;
+    }
+    
     int list_start = y + 2;
     int list_height = h - 3;
     int max_line = y + h - 1;
@@ -1042,12 +4448,21 @@ void draw_process_list(int x, int y, int w, int h) {
     
     /* Available width for variable columns */
     int fixed_width = pid_width + mem_width + cpu_width + PROC_COLUMN_SPACING;
+    
+    /* Optional columns go after Cpu%, as many as leave room for the program */
+    unsigned int extra_cols = 0;
+    for (int c = 0; c < NUM_PROC_COLUMNS; c++) {
+        if (!(g_columns & (1u << c))) continue;
+        if (w - fixed_width - PROC_COLUMNS[c].width - 1 < min_prog_width + PROC_NARROW_OFFSET) break;
+        fixed_width += PROC_COLUMNS[c].width + 1;
+        extra_cols |= 1u << c;
+    }
     int var_width = w - fixed_width;
     
     /* Determine what columns to show based on width */
     int show_user = 1;
     int show_cmd = 1;
-    int prog_width, cmd_width, user_width;
+    int prog_width, cmd_width = 0, user_width = 0;
     
     if (var_width < min_prog_width + min_user_width) {
         /* Very narrow - just show PID, Program, CPU% */
@@ -1094,18 +4509,24 @@ void draw_process_list(int x, int y, int w, int h) {
     cx += mem_width + 1;
     
     tb_printf(cx, list_start - 1, COLOR_HEADER | TB_BOLD, COLOR_BG, "%-*s", cpu_width, "Cpu%");
+    cx += cpu_width + 1;
     
-    /* Scroll handling */
-    if (g_selected_process < g_scroll_offset) {
-        g_scroll_offset = g_selected_process;
-    } else if (g_selected_process >= g_scroll_offset + list_height) {
-        g_scroll_offset = g_selected_process - list_height + 1;
+    for (int c = 0; c < NUM_PROC_COLUMNS; c++) {
+        if (!(extra_cols & (1u << c))) continue;
+        tb_printf(cx, list_start - 1, COLOR_HEADER | TB_BOLD, COLOR_BG, "%*s", PROC_COLUMNS[c].width, PROC_COLUMNS[c].header);
+        cx += PROC_COLUMNS[c].width + 1;
     }
     
+    /* Scroll handling */
+    g_proc_rows = list_height;
+    clamp_scroll(list_height);
+    ensure_sorted(g_scroll_offset + list_height);
+    
     /* Process rows */
-    for (int i = 0; i < list_height && (g_scroll_offset + i) < g_stats.process_count; i++) {
+    for (int i = 0; i < list_height && (g_scroll_offset + i) < view_rows(); i++) {
         int idx = g_scroll_offset + i;
-        ProcessInfo *proc = &g_stats.processes[idx];
+        ProcessInfo *proc = proc_at(idx);
+        const ProcDetail *detail = detail_at(idx);
         int row = list_start + i;
         
         if (row >= max_line) break;
@@ -1118,29 +4539,76 @@ void draw_process_list(int x, int y, int w, int h) {
             row_bg = COLOR_HEADER;
         }
         
-        /* Truncate strings to fit */
+        /* A thread row: TID, the name indented under its process, and state and
+         * last CPU where the command goes; threads share Mem and the rest */
+        int thread = view_thread(idx);
+        if (thread >= 0) {
+            const ThreadInfo *t = &g_stats.threads[thread];
+            int indent = (g_tree_view ? g_tree.depth[view_index(idx)] * 2 : 0) + 2;
+            if (indent > prog_width / 2) indent = prog_width / 2;
+            cx = x;
+            tb_printf(cx, row, row_fg, row_bg, "%-*d", pid_width, t->tid);
+            cx += pid_width + 1;
+            tb_printf(cx, row, row_fg, row_bg, "%*s%-*.*s", indent, "", prog_width - indent, prog_width - indent, t->name);
+            cx += prog_width + 1;
+            if (show_cmd) {
+                char info[64];
+                snprintf(info, sizeof(info), "thread, state %c, on CPU %d", t->state, t->processor);
+                tb_printf(cx, row, row_fg, row_bg, "%-*.*s", cmd_width, cmd_width, info);
+                cx += cmd_width + 1;
+            }
+            if (show_user) {
+                tb_printf(cx, row, row_fg, row_bg, "%-*s", user_width, "");
+                cx += user_width + 1;
+            }
+            tb_printf(cx, row, row_fg, row_bg, "%-*s", mem_width, "");
+            cx += mem_width + 1;
+            uint32_t cpu_color = t->cpu_percent > 50 ? COLOR_HIGH :
+                                 t->cpu_percent > 20 ? COLOR_MED : COLOR_LOW;
+            tb_printf(cx, row, cpu_color, row_bg, "%*.1f", cpu_width - 1, t->cpu_percent);
+            continue;
+        }
+        
+        /* In the tree, names are indented by depth and marked when they have
+         * children ('-') or are collapsed ('+'); Mem and Cpu% cover the subtree */
         char name[256], cmd[256], user[32], mem_buf[32];
-        strncpy(name, proc->name, prog_width);
+        long mem_rss = proc->mem_rss;
+        float cpu_percent = proc->cpu_percent;
+        int name_len = 0;
+        if (g_tree_view) {
+            int i = view_index(idx);
+            int indent = g_tree.depth[i] * 2;
+            if (indent > prog_width / 2) indent = prog_width / 2;
+            memset(name, ' ', indent);
+            name_len = indent;
+            if (name_len + 2 <= prog_width) {
+                name[name_len++] = (g_tree.flags[i] & TREE_COLLAPSED) ? '+' : tree_has_children(i) ? '-' : ' ';
+                name[name_len++] = ' ';
+            }
+            mem_rss = g_tree.mem[i];
+            cpu_percent = g_tree.cpu[i];
+        }
+        strncpy(name + name_len, proc->name, prog_width - name_len);
         name[prog_width] = '\0';
         
         if (show_cmd) {
-            strncpy(cmd, proc->cmdline, cmd_width);
+            strncpy(cmd, detail ? detail->cmdline : proc->name, cmd_width);
             cmd[cmd_width] = '\0';
         }
         
         if (show_user) {
-            strncpy(user, proc->user, user_width);
+            strncpy(user, detail ? detail->user : "", user_width);
             user[user_width] = '\0';
         }
         
-        format_bytes(proc->mem_rss * 1024, mem_buf, sizeof(mem_buf));
+        format_bytes(mem_rss * 1024, mem_buf, sizeof(mem_buf));
         /* Truncate memory string if needed */
         if ((int)strlen(mem_buf) > mem_width) {
             mem_buf[mem_width] = '\0';
         }
         
-        uint32_t cpu_color = proc->cpu_percent > 50 ? COLOR_HIGH :
-                             proc->cpu_percent > 20 ? COLOR_MED : COLOR_LOW;
+        uint32_t cpu_color = cpu_percent > 50 ? COLOR_HIGH :
+                             cpu_percent > 20 ? COLOR_MED : COLOR_LOW;
         
         /* Draw row with proper widths */
         cx = x;
@@ -1164,14 +4632,27 @@ void draw_process_list(int x, int y, int w, int h) {
         cx += mem_width + 1;
         
         tb_printf(cx, row, cpu_color | (idx == g_selected_process ? 0 : TB_BOLD), row_bg,
-                  "%*.1f", cpu_width - 1, proc->cpu_percent);
+                  "%*.1f", cpu_width - 1, cpu_percent);
+        cx += cpu_width + 1;
+        
+        for (int c = 0; c < NUM_PROC_COLUMNS; c++) {
+            if (!(extra_cols & (1u << c))) continue;
+            char value[32];
+            PROC_COLUMNS[c].format(proc, value, sizeof(value));
+            tb_printf(cx, row, row_fg, row_bg, "%*.*s", PROC_COLUMNS[c].width, PROC_COLUMNS[c].width, value);
+            cx += PROC_COLUMNS[c].width + 1;
+        }
     }
     
     /* Status bar at bottom - show sort mode */
     if (max_line > y + 2) {
-        char status[128];
-        snprintf(status, sizeof(status), "%d/%d | %d | Sort:%s",
-                 g_stats.running_count, g_stats.process_count, g_selected_process + 1, get_sort_name());
+        char status[128], dropped[48] = "";
+        if (g_stats.fd_dropped > 0) {
+            snprintf(dropped, sizeof(dropped), " | %d skipped: fd limit", g_stats.fd_dropped);
+        }
+        snprintf(status, sizeof(status), "%d/%d | %d | Sort:%s%s%s",
+                 g_stats.running_count, g_stats.process_count, g_selected_process + 1, get_sort_name(),
+                 g_tree_view ? " | Tree" : "", dropped);
         int status_len = strlen(status);
         if (status_len > w - 2) status_len = w - 2;
         tb_printf(x, max_line, COLOR_FG, COLOR_BG, "%s", status);
@@ -1203,7 +4684,7 @@ void draw_top_bar(int w) {
 
 void draw_help_bar(int y, int w) {
     tb_printf(2, y, COLOR_FG, COLOR_BG, 
-              "1-5:toggle | C-f/b:sort | C-n/p:nav | C-v/M-v:page | C-a/e:home/end | k:t:s:signal | q:quit");
+              "1-5:toggle | C-f/b:sort | C-n/p:nav | C-v/M-v:page | C-a/e:home/end | k:t:s:signal | x:exited | c:columns | e:tree | h/H:threads | q:quit");
 }
 
 void draw_signal_menu(int w, int h) {
@@ -1215,8 +4696,8 @@ void draw_signal_menu(int w, int h) {
     if (x < 2) x = 2;
     if (y < 2) y = 2;
     
-    if (g_selected_process < 0 || g_selected_process >= g_stats.process_count) return;
-    ProcessInfo *proc = &g_stats.processes[g_selected_process];
+    if (g_selected_process < 0 || g_selected_process >= view_rows()) return;
+    ProcessInfo *proc = proc_at(g_selected_process);
     
     for (int dy = 0; dy < menu_h; dy++) {
         for (int dx = 0; dx < menu_w; dx++) {
@@ -1270,6 +4751,41 @@ void draw_signal_menu(int w, int h) {
     tb_printf(x + 2, y + menu_h - 1, COLOR_HEADER, COLOR_HEADER, "Up/Dn:select Enter:send Esc:close");
 }
 
+void draw_column_menu(int w, int h) {
+    int menu_w = 44;
+    int menu_h = NUM_PROC_COLUMNS + 4;
+    int x = (w - menu_w) / 2;
+    int y = (h - menu_h) / 2;
+    
+    if (x < 2) x = 2;
+    if (y < 2) y = 2;
+    
+    for (int dy = 0; dy < menu_h; dy++) {
+        for (int dx = 0; dx < menu_w; dx++) {
+            uint32_t ch = ' ';
+            if (dy == 0 || dy == menu_h - 1) {
+                ch = (dx == 0 || dx == menu_w - 1) ? '+' : '-';
+            } else if (dx == 0 || dx == menu_w - 1) {
+                ch = '|';
+            }
+            tb_set_cell(x + dx, y + dy, ch, COLOR_HEADER, COLOR_HEADER);
+        }
+    }
+    
+    tb_printf(x + 2, y, TB_BLACK, COLOR_HEADER, "Process columns");
+    
+    if (g_column_selected < 0) g_column_selected = 0;
+    if (g_column_selected >= NUM_PROC_COLUMNS) g_column_selected = NUM_PROC_COLUMNS - 1;
+    
+    for (int i = 0; i < NUM_PROC_COLUMNS; i++) {
+        uint32_t fg = i == g_column_selected ? TB_BLACK : COLOR_FG;
+        tb_printf(x + 2, y + 2 + i, fg, COLOR_HEADER, "[%c] %s",
+                  (g_columns & (1u << i)) ? 'x' : ' ', PROC_COLUMNS[i].label);
+    }
+    
+    tb_printf(x + 2, y + menu_h - 1, COLOR_HEADER, COLOR_HEADER, "Up/Dn:select Space:toggle Esc:close");
+}
+
 void draw_signal_sent_message(int w, int h) {
     int msg_w = 35;
     int msg_h = 3;
@@ -1316,8 +4832,8 @@ void draw_confirm_menu(int w, int h, const char *sig_name) {
     if (x < 2) x = 2;
     if (y < 2) y = 2;
     
-    if (g_selected_process < 0 || g_selected_process >= g_stats.process_count) return;
-    ProcessInfo *proc = &g_stats.processes[g_selected_process];
+    if (g_selected_process < 0 || g_selected_process >= view_rows()) return;
+    ProcessInfo *proc = proc_at(g_selected_process);
     
     for (int dy = 0; dy < menu_h; dy++) {
         for (int dx = 0; dx < menu_w; dx++) {
@@ -1563,6 +5079,10 @@ void draw_screen(void) {
         draw_signal_menu(w, h);
     }
     
+    if (g_column_menu_active) {
+        draw_column_menu(w, h);
+    }
+    
     /* Draw confirmation menu overlay if active */
     if (g_confirm_menu_active) {
         const char *sig_name = (g_confirm_signal == SIGKILL) ? "SIGKILL" : "SIGTERM";
@@ -1577,12 +5097,6 @@ void draw_screen(void) {
     tb_present();
 }
 
-int64_t get_time_ms(void) {
-    struct timespec ts;
-    clock_gettime(CLOCK_MONOTONIC, &ts);
-    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
-}
-
 /* Get config directory path */
 void get_config_dir(char *buf, size_t buflen) {
     const char *xdg_config = getenv("XDG_CONFIG_HOME");
@@ -1623,6 +5137,21 @@ void save_settings(void) {
     fprintf(fp, "show_proc=%d\n", g_show_proc);
     fprintf(fp, "sort_mode=%d\n", g_sort_mode);
     fprintf(fp, "refresh_rate=%d\n", g_refresh_rate_ms);
+    fprintf(fp, "fd_cache_limit=%d\n", g_fd_cache_limit);
+    fprintf(fp, "scan_threads=%d\n", g_scan_threads);
+    fprintf(fp, "scan_io_uring=%d\n", g_scan_io_uring);
+    fprintf(fp, "proc_events=%d\n", g_proc_events_enabled);
+    fprintf(fp, "tree_view=%d\n", g_tree_view);
+    fprintf(fp, "show_threads=%d\n", g_show_threads);
+    fprintf(fp, "columns=");
+    for (int i = 0, n = 0; i < NUM_PROC_COLUMNS; i++) {
+        if (g_columns & (1u << i)) fprintf(fp, "%s%s", n++ ? "," : "", PROC_COLUMNS[i].key);
+    }
+    fprintf(fp, "\n");
+    for (int i = 0; i < NUM_COLLECTORS; i++) {
+        if (g_collectors[i].changed) continue;
+        fprintf(fp, "%s_interval=%d\n", g_collectors[i].name, g_collectors[i].interval_ms);
+    }
     
     fclose(fp);
 }
@@ -1643,6 +5172,17 @@ void load_settings(void) {
         /* Skip comments and empty lines */
         if (line[0] == '#' || line[0] == '\n') continue;
         
+        /* columns=<key>,<key>,... lists the optional process columns shown */
+        if (strncmp(line, "columns=", 8) == 0) {
+            g_columns = 0;
+            for (char *tok = strtok(line + 8, ",\n"); tok; tok = strtok(NULL, ",\n")) {
+                for (int i = 0; i < NUM_PROC_COLUMNS; i++) {
+                    if (strcmp(tok, PROC_COLUMNS[i].key) == 0) g_columns |= 1u << i;
+                }
+            }
+            continue;
+        }
+        
         char key[64];
         int value;
         if (sscanf(line, "%63[^=]=%d", key, &value) == 2) {
@@ -1657,15 +5197,52 @@ void load_settings(void) {
             else if (strcmp(key, "refresh_rate") == 0) {
                 if (value >= 100 && value <= 10000) g_refresh_rate_ms = value;
             }
+            else if (strcmp(key, "fd_cache_limit") == 0) {
+                /* 0 disables fd caching; the effective budget is capped by RLIMIT_NOFILE */
+                if (value >= 0 && value <= 1048576) g_fd_cache_limit = value;
+            }
+            else if (strcmp(key, "scan_threads") == 0) {
+                /* 0 picks one thread per CPU, up to 8 */
+                if (value >= 0 && value <= MAX_SCAN_THREADS) g_scan_threads = value;
+            }
+            else if (strcmp(key, "scan_io_uring") == 0) g_scan_io_uring = value;
+            else if (strcmp(key, "proc_events") == 0) g_proc_events_enabled = value;
+            else if (strcmp(key, "tree_view") == 0) g_tree_view = value;
+            else if (strcmp(key, "show_threads") == 0) g_show_threads = value;
+            else {
+                /* <collector>_interval in ms; 0 follows refresh_rate */
+                for (int i = 0; i < NUM_COLLECTORS; i++) {
+                    size_t len = strlen(g_collectors[i].name);
+                    if (g_collectors[i].changed || strncmp(key, g_collectors[i].name, len) != 0 ||
+                        strcmp(key + len, "_interval") != 0) continue;
+                    if (value == 0 || (value >= 100 && value <= 3600000)) g_collectors[i].interval_ms = value;
+                }
+            }
         }
     }
     
     fclose(fp);
+    
+    /* A column sort mode needs its column shown */
+    if (!sort_mode_available(g_sort_mode)) g_sort_mode = SORT_CPU_LAZY;
 }
 
 int main(int argc, char *argv[]) {
-    (void)argc;
-    (void)argv;
+    int opt;
+    while ((opt = getopt(argc, argv, "j:h")) != -1) {
+        if (opt == 'j') {
+            char *end;
+            long n = strtol(optarg, &end, 10);
+            if (*end != '\0' || n < 1 || n > MAX_SCAN_THREADS) {
+                fprintf(stderr, "ctop: -j expects 1 to %d threads\n", MAX_SCAN_THREADS);
+                return 1;
+            }
+            g_scan_threads_cli = (int)n;
+        } else {
+            fprintf(stderr, "Usage: %s [-j threads]\n", argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
     
     int ret = tb_init();
     if (ret != TB_OK) {
@@ -1678,11 +5255,20 @@ int main(int argc, char *argv[]) {
     
     load_settings();
     
+    /* First frame from a synchronous sample, then hand collection off */
     update_stats();
+    adopt_snapshot();
+    if (g_show_proc) fetch_visible_details();
     draw_screen();
     
-    int64_t last_update = get_time_ms();
-    int64_t prev_update = last_update;
+    if (start_collector() != 0) {
+        tb_shutdown();
+        fprintf(stderr, "Failed to start the collector thread\n");
+        return 1;
+    }
+    
+    int ttyfd = -1, resizefd = -1;
+    tb_get_fds(&ttyfd, &resizefd);
     
     while (g_running) {
         int w = tb_width();
@@ -1691,49 +5277,83 @@ int main(int argc, char *argv[]) {
         calculate_minimum_size(&min_w, &min_h);
         int in_error_mode = (w < min_w || h < min_h);
         
-        int64_t now = get_time_ms();
-        int64_t time_until_update = g_refresh_rate_ms - (now - last_update);
-        if (time_until_update < 0) time_until_update = 0;
-        
+        /* Handle input termbox already buffered, otherwise sleep until a key,
+         * a resize, a new snapshot or the signal message expiring */
         struct tb_event ev;
-        ret = tb_peek_event(&ev, (int)time_until_update);
+        ret = tb_peek_event(&ev, 0);
+        if (ret == TB_ERR_NO_EVENT) {
+            int timeout = -1;
+            if (g_signal_sent) {
+                int64_t left = 2000 - (get_time_ms() - g_signal_sent_time);
+                timeout = left > 0 ? (int)left + 1 : 0;
+            }
+            struct pollfd fds[3] = {
+                {ttyfd, POLLIN, 0},
+                {resizefd, POLLIN, 0},
+                {g_ui_wake[0], POLLIN, 0},
+            };
+            poll(fds, 3, timeout);
+            if (fds[2].revents & POLLIN) drain(g_ui_wake[0]);
+            ret = tb_peek_event(&ev, 0);
+        }
         
         int need_redraw = 0;
         int pane_toggled = 0;
         int sort_changed = 0;
+        int settings_changed = 0;
         
         if (ret == TB_OK) {
             if (ev.type == TB_EVENT_KEY) {
                 if (ev.ch == '1') {
-                    g_show_cpu = !g_show_cpu;
+                    __atomic_store_n(&g_show_cpu, !g_show_cpu, __ATOMIC_RELAXED);
                     need_redraw = 1;
                     pane_toggled = 1;
                 } else if (ev.ch == '2') {
-                    g_show_mem = !g_show_mem;
+                    __atomic_store_n(&g_show_mem, !g_show_mem, __ATOMIC_RELAXED);
                     need_redraw = 1;
                     pane_toggled = 1;
                 } else if (ev.ch == '3') {
-                    g_show_disks = !g_show_disks;
+                    __atomic_store_n(&g_show_disks, !g_show_disks, __ATOMIC_RELAXED);
                     need_redraw = 1;
                     pane_toggled = 1;
                 } else if (ev.ch == '4') {
-                    g_show_net = !g_show_net;
+                    __atomic_store_n(&g_show_net, !g_show_net, __ATOMIC_RELAXED);
                     need_redraw = 1;
                     pane_toggled = 1;
                 } else if (ev.ch == '5') {
-                    g_show_proc = !g_show_proc;
+                    __atomic_store_n(&g_show_proc, !g_show_proc, __ATOMIC_RELAXED);
                     need_redraw = 1;
                     pane_toggled = 1;
-                } else if (ev.key == TB_KEY_CTRL_F) {
-                    /* Cycle sort mode forward */
-                    g_sort_mode = (g_sort_mode + 1) % SORT_MAX;
-                    need_redraw = 1;
-                    sort_changed = 1;
-                } else if (ev.key == TB_KEY_CTRL_B) {
-                    /* Cycle sort mode backward */
-                    g_sort_mode = (g_sort_mode - 1 + SORT_MAX) % SORT_MAX;
+                } else if (ev.key == TB_KEY_CTRL_F || ev.key == TB_KEY_CTRL_B) {
+                    /* Cycle sort mode, skipping hidden columns */
+                    int step = ev.key == TB_KEY_CTRL_F ? 1 : SORT_MAX - 1;
+                    int mode = g_sort_mode;
+                    do {
+                        mode = (mode + step) % SORT_MAX;
+                    } while (!sort_mode_available(mode));
+                    __atomic_store_n(&g_sort_mode, mode, __ATOMIC_RELAXED);
                     need_redraw = 1;
                     sort_changed = 1;
+                } else if (g_column_menu_active) {
+                    if (ev.key == TB_KEY_ESC || ev.ch == 'c' || ev.ch == 'C') {
+                        g_column_menu_active = 0;
+                        need_redraw = 1;
+                    } else if (ev.key == TB_KEY_ARROW_UP || ev.key == TB_KEY_CTRL_P) {
+                        if (g_column_selected > 0) g_column_selected--;
+                        need_redraw = 1;
+                    } else if (ev.key == TB_KEY_ARROW_DOWN || ev.key == TB_KEY_CTRL_N) {
+                        if (g_column_selected < NUM_PROC_COLUMNS - 1) g_column_selected++;
+                        need_redraw = 1;
+                    } else if (ev.key == TB_KEY_ENTER || ev.key == TB_KEY_SPACE || ev.ch == ' ') {
+                        __atomic_store_n(&g_columns, g_columns ^ (1u << g_column_selected), __ATOMIC_RELAXED);
+                        /* Hiding the sort column falls back to the default sort */
+                        if (!sort_mode_available(g_sort_mode)) {
+                            __atomic_store_n(&g_sort_mode, SORT_CPU_LAZY, __ATOMIC_RELAXED);
+                            sort_changed = 1;
+                        }
+                        settings_changed = 1;
+                        need_redraw = 1;
+                    }
                 } else if (g_signal_menu_active) {
                     if (ev.key == TB_KEY_ESC) {
                         g_signal_menu_active = 0;
@@ -1745,8 +5365,8 @@ int main(int argc, char *argv[]) {
                         if (g_signal_selected < NUM_SIGNALS - 1) g_signal_selected++;
                         need_redraw = 1;
                     } else if (ev.key == TB_KEY_ENTER) {
-                        if (g_selected_process >= 0 && g_selected_process < g_stats.process_count) {
-                            int pid = g_stats.processes[g_selected_process].pid;
+                        if (g_selected_process >= 0 && g_selected_process < view_rows()) {
+                            int pid = proc_at(g_selected_process)->pid;
                             int sig = SIGNALS[g_signal_selected].signum;
                             send_signal_to_process(pid, sig);
                             g_signal_sent = 1;
@@ -1762,8 +5382,8 @@ int main(int argc, char *argv[]) {
                         g_confirm_menu_active = 0;
                         need_redraw = 1;
                     } else if (ev.key == TB_KEY_ENTER) {
-                        if (g_selected_process >= 0 && g_selected_process < g_stats.process_count) {
-                            int pid = g_stats.processes[g_selected_process].pid;
+                        if (g_selected_process >= 0 && g_selected_process < view_rows()) {
+                            int pid = proc_at(g_selected_process)->pid;
                             int sig = g_confirm_signal;
                             send_signal_to_process(pid, sig);
                             g_signal_sent = 1;
@@ -1774,31 +5394,70 @@ int main(int argc, char *argv[]) {
                         g_confirm_menu_active = 0;
                         need_redraw = 1;
                     }
-                } else if (g_show_proc && g_stats.process_count > 0 && (ev.ch == 'k' || ev.ch == 'K')) {
+                } else if (g_show_proc && !g_show_exited && g_stats.process_count > 0 && (ev.ch == 'k' || ev.ch == 'K')) {
                     g_confirm_menu_active = 1;
                     g_confirm_signal = SIGKILL;
                     need_redraw = 1;
-                } else if (g_show_proc && g_stats.process_count > 0 && (ev.ch == 't' || ev.ch == 'T')) {
+                } else if (g_show_proc && !g_show_exited && g_stats.process_count > 0 && (ev.ch == 't' || ev.ch == 'T')) {
                     g_confirm_menu_active = 1;
                     g_confirm_signal = SIGTERM;
                     need_redraw = 1;
-                } else if (g_show_proc && g_stats.process_count > 0 && (ev.ch == 's' || ev.ch == 'S')) {
+                } else if (g_show_proc && !g_show_exited && g_stats.process_count > 0 && (ev.ch == 's' || ev.ch == 'S')) {
                     g_signal_menu_active = 1;
                     g_signal_selected = 0;
                     need_redraw = 1;
+                } else if (g_show_proc && (ev.ch == 'c' || ev.ch == 'C')) {
+                    g_column_menu_active = 1;
+                    need_redraw = 1;
+                } else if (g_show_proc && (ev.ch == 'x' || ev.ch == 'X')) {
+                    g_show_exited = !g_show_exited;
+                    need_redraw = 1;
+                } else if (g_show_proc && !g_show_exited && (ev.ch == 'e' || ev.ch == 'E')) {
+                    /* Keep the selected process selected across the switch */
+                    int pid = g_selected_process >= 0 && g_selected_process < view_rows() ?
+                              proc_at(g_selected_process)->pid : -1;
+                    g_tree_view = !g_tree_view;
+                    sort_processes();
+                    int row = pid > 0 ? view_find_row(pid) : -1;
+                    if (row >= 0) g_selected_process = row;
+                    if (g_selected_process >= view_rows()) g_selected_process = view_rows() - 1;
+                    settings_changed = 1;
+                    need_redraw = 1;
+                } else if (g_show_proc && !g_show_exited && (ev.ch == 'h' || ev.ch == 'H')) {
+                    /* h lists the selected process's threads, H those of every
+                     * process in view; the selection stays on the process */
+                    int pid = g_selected_process >= 0 && g_selected_process < view_rows() ?
+                              proc_at(g_selected_process)->pid : -1;
+                    if (ev.ch == 'H') {
+                        g_show_threads = !g_show_threads;
+                        settings_changed = 1;
+                    } else if (pid > 0) {
+                        pid_set_update(&g_thread_expanded, pid, -1);
+                    }
+                    rows_build();
+                    int row = pid > 0 ? view_find_row(pid) : -1;
+                    if (row >= 0) g_selected_process = row;
+                    need_redraw = 1;
+                } else if (g_show_proc && !g_show_exited && g_tree_view && view_rows() > 0 &&
+                           (ev.ch == '+' || ev.ch == '-' || ev.ch == ' ' || ev.key == TB_KEY_SPACE)) {
+                    if (g_selected_process >= 0 && g_selected_process < view_rows()) {
+                        int collapse = ev.ch == '+' ? 0 : ev.ch == '-' ? 1 : -1;
+                        tree_set_collapsed(proc_at(g_selected_process)->pid, collapse);
+                        need_redraw = 1;
+                    }
                 } else if (ev.ch == 'q' || ev.ch == 'Q' || ev.key == TB_KEY_ESC || 
                           ev.key == TB_KEY_CTRL_C) {
-                    g_running = 0;
+                    __atomic_store_n(&g_running, 0, __ATOMIC_RELAXED);
                 } else if (!in_error_mode && g_show_proc && (ev.key == TB_KEY_CTRL_N || ev.key == TB_KEY_ARROW_DOWN)) {
-                    if (g_selected_process < g_stats.process_count - 1) g_selected_process++;
+                    if (g_selected_process < view_rows() - 1) g_selected_process++;
                     need_redraw = 1;
                 } else if (!in_error_mode && g_show_proc && (ev.key == TB_KEY_CTRL_P || ev.key == TB_KEY_ARROW_UP)) {
                     if (g_selected_process > 0) g_selected_process--;
                     need_redraw = 1;
                 } else if (!in_error_mode && g_show_proc && (ev.key == TB_KEY_CTRL_V || ev.key == TB_KEY_PGDN)) {
                     g_selected_process += 10;
-                    if (g_selected_process >= g_stats.process_count)
-                        g_selected_process = g_stats.process_count - 1;
+                    if (g_selected_process >= view_rows())
+                        g_selected_process = view_rows() - 1;
                     need_redraw = 1;
                 } else if (!in_error_mode && g_show_proc && ((ev.key == 'v' && (ev.mod & TB_MOD_ALT)) || ev.key == TB_KEY_PGUP)) {
                     g_selected_process -= 10;
@@ -1808,7 +5467,7 @@ int main(int argc, char *argv[]) {
                     g_selected_process = 0;
                     need_redraw = 1;
                 } else if (!in_error_mode && g_show_proc && (ev.key == TB_KEY_CTRL_E || ev.key == TB_KEY_END)) {
-                    g_selected_process = g_stats.process_count - 1;
+                    g_selected_process = view_rows() - 1;
                     need_redraw = 1;
                 }
             } else if (ev.type == TB_EVENT_RESIZE) {
@@ -1816,34 +5475,36 @@ int main(int argc, char *argv[]) {
             }
         }
         
-        if (need_redraw) {
-            draw_screen();
-        }
-        
         /* Clear signal sent message after 2 seconds */
         if (g_signal_sent && get_time_ms() - g_signal_sent_time > 2000) {
             g_signal_sent = 0;
             need_redraw = 1;
         }
         
-        /* Update stats and redraw periodically, or immediately after pane toggle or sort change */
-        now = get_time_ms();
-        if (pane_toggled || sort_changed || now - last_update >= g_refresh_rate_ms) {
-            if (pane_toggled) {
-                save_settings();
-            }
-            g_elapsed_seconds = (now - prev_update) / 1000.0f;
-            if (g_elapsed_seconds <= 0) g_elapsed_seconds = 1.0f;
-            if (!in_error_mode || pane_toggled || sort_changed) {
-                update_stats();
-            }
-            prev_update = now;
-            last_update = now;
+        /* Pick up the collector's newest sample, if it published one */
+        if (adopt_snapshot()) need_redraw = 1;
+        
+        /* A new sort mode only reorders the shown sample; collecting again here
+         * would also shorten the CPU% delta window of the next tick */
+        if (sort_changed) sort_processes();
+        
+        /* Collectors of a newly shown pane are overdue; wake the collector so
+         * they run right away */
+        if (pane_toggled) {
+            wake(g_collector_wake[1]);
+            save_settings();
+        }
+        if (settings_changed) save_settings();
+        
+        if (need_redraw) {
+            /* Rows scrolled into view get their details before they are drawn */
+            if (g_show_proc) fetch_visible_details();
             draw_screen();
         }
     }
     
     save_settings();
     tb_shutdown();
+    stop_collector();
     return 0;
 }